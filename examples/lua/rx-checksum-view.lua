@@ -0,0 +1,10 @@
+-- Sum received bytes without copying them into Lua strings (requires LuaJIT)
+sum = 0
+tio.on_rx(function(data, length)
+  for i = 0, length - 1 do
+    sum = (sum + data[i]) % 65536
+  end
+end, true)
+tio.every(1000, function()
+  print(string.format("checksum: 0x%04x", sum))
+end)
@@ -281,6 +281,8 @@ static void config_parse_keys(GKeyFile *key_file, char *group)
         g_free((void *)string);
         string = NULL;
     }
+    config_get_integer(key_file, group, "script-memory-limit", &option.script_memory_limit, 0, INT_MAX / 1024);
+    config_get_integer(key_file, group, "script-instruction-limit", &option.script_instruction_limit, 0, INT_MAX);
     config_get_string(key_file, group, "exec", &option.exec, NULL);
     config_get_string(key_file, group, "prefix-ctrl-key", &string, NULL);
     if (string != NULL)
@@ -623,21 +625,16 @@ void config_file_parse(void)
         exit(EXIT_FAILURE);
     }
 
-    // Parse default group/section
-    if (g_key_file_has_group(keyfile, CONFIG_GROUP_NAME_DEFAULT))
-    {
-        config_parse_keys(keyfile, CONFIG_GROUP_NAME_DEFAULT);
-    }
+    // Find group/section of target, by name or else by pattern
+    char *profile = NULL;
+    char *matched_device = NULL;
 
-    // Parse target
     if (g_key_file_has_group(keyfile, option.target))
     {
-        config.active_group = strdup(option.target);
-        config_parse_keys(keyfile, option.target);
+        profile = strdup(option.target);
     }
     else
     {
-        // Find group by pattern
         gsize num_groups;
         gchar **group = g_key_file_get_groups(keyfile, &num_groups);
 
@@ -674,15 +671,8 @@ void config_file_parse(void)
             if (config.device != NULL)
             {
                 // Match found - save device
-                device = strdup(config.device);
-
-                // Parse found group (may replace config.device)
-                config_parse_keys(keyfile, group[i]);
-
-                // Update configuration
-                config.active_group = strdup(group[i]);
-                config.device = device; // Restore new device string
-
+                profile = strdup(group[i]);
+                matched_device = strdup(config.device);
                 break;
             }
         }
@@ -690,6 +680,28 @@ void config_file_parse(void)
         g_strfreev(group);
     }
 
+    // Headless transfers only use the configuration file if a profile is requested
+    if ((profile != NULL) || (option.transfer == TRANSFER_NONE))
+    {
+        // Parse default group/section
+        if (g_key_file_has_group(keyfile, CONFIG_GROUP_NAME_DEFAULT))
+        {
+            config_parse_keys(keyfile, CONFIG_GROUP_NAME_DEFAULT);
+        }
+
+        // Parse group of target (may replace config.device)
+        if (profile != NULL)
+        {
+            config_parse_keys(keyfile, profile);
+            config.active_group = profile;
+            if (matched_device != NULL)
+            {
+                // Restore new device string of pattern match
+                config.device = matched_device;
+            }
+        }
+    }
+
     // Cleanup
     g_key_file_free(keyfile);
     g_string_free(config_buffer, TRUE);
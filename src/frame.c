@@ -0,0 +1,352 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Binary framing (COBS, SLIP, HDLC-like byte stuffing) and table driven CRC
+ * routines used by the Lua API.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "frame.h"
+
+#define SLIP_ESC       0xDB
+#define SLIP_ESC_END   0xDC
+#define SLIP_ESC_ESC   0xDD
+
+#define HDLC_ESCAPE    0x7D
+#define HDLC_XOR       0x20
+
+/* Frames are delimited by a zero byte which is not included */
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_index = 0, o = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == 0)
+        {
+            out[code_index] = code;
+            code_index = o++;
+            code = 1;
+            continue;
+        }
+
+        out[o++] = in[i];
+        if (++code == 0xFF)
+        {
+            out[code_index] = code;
+            code_index = o++;
+            code = 1;
+        }
+    }
+    out[code_index] = code;
+
+    return o;
+}
+
+ssize_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t i = 0, o = 0;
+
+    while (i < len)
+    {
+        uint8_t code = in[i++];
+
+        if ((code == 0) || (i + code - 1 > len))
+        {
+            return -1;
+        }
+        for (int j = 1; j < code; j++)
+        {
+            if (in[i] == 0)
+            {
+                return -1;
+            }
+            out[o++] = in[i++];
+        }
+        if ((code != 0xFF) && (i < len))
+        {
+            out[o++] = 0;
+        }
+    }
+
+    return o;
+}
+
+/* RFC 1055, frame is surrounded by END bytes */
+size_t slip_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t o = 0;
+
+    out[o++] = SLIP_END;
+    for (size_t i = 0; i < len; i++)
+    {
+        switch (in[i])
+        {
+            case SLIP_END:
+                out[o++] = SLIP_ESC;
+                out[o++] = SLIP_ESC_END;
+                break;
+            case SLIP_ESC:
+                out[o++] = SLIP_ESC;
+                out[o++] = SLIP_ESC_ESC;
+                break;
+            default:
+                out[o++] = in[i];
+                break;
+        }
+    }
+    out[o++] = SLIP_END;
+
+    return o;
+}
+
+/* Decode frame contents, END bytes are skipped */
+ssize_t slip_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == SLIP_END)
+        {
+            continue;
+        }
+        if (in[i] != SLIP_ESC)
+        {
+            out[o++] = in[i];
+            continue;
+        }
+        if (++i == len)
+        {
+            return -1;
+        }
+        switch (in[i])
+        {
+            case SLIP_ESC_END:
+                out[o++] = SLIP_END;
+                break;
+            case SLIP_ESC_ESC:
+                out[o++] = SLIP_ESC;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return o;
+}
+
+/* RFC 1662 style byte stuffing, frame is surrounded by flag bytes */
+size_t hdlc_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t o = 0;
+
+    out[o++] = HDLC_FLAG;
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((in[i] == HDLC_FLAG) || (in[i] == HDLC_ESCAPE))
+        {
+            out[o++] = HDLC_ESCAPE;
+            out[o++] = in[i] ^ HDLC_XOR;
+        }
+        else
+        {
+            out[o++] = in[i];
+        }
+    }
+    out[o++] = HDLC_FLAG;
+
+    return o;
+}
+
+/* Decode frame contents, flag bytes are skipped */
+ssize_t hdlc_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == HDLC_FLAG)
+        {
+            continue;
+        }
+        if (in[i] != HDLC_ESCAPE)
+        {
+            out[o++] = in[i];
+            continue;
+        }
+        if ((++i == len) || (in[i] == HDLC_FLAG))
+        {
+            return -1;
+        }
+        out[o++] = in[i] ^ HDLC_XOR;
+    }
+
+    return o;
+}
+
+static crc_t crcs[] =
+{
+    { .name = "crc8", .width = 8, .poly = 0x07, .init = 0x00, .reflect = false, .xorout = 0x00 },
+    { .name = "crc8-maxim", .width = 8, .poly = 0x31, .init = 0x00, .reflect = true, .xorout = 0x00 },
+    { .name = "crc16-ccitt", .width = 16, .poly = 0x1021, .init = 0xFFFF, .reflect = false, .xorout = 0x0000 },
+    { .name = "crc16-xmodem", .width = 16, .poly = 0x1021, .init = 0x0000, .reflect = false, .xorout = 0x0000 },
+    { .name = "crc16-kermit", .width = 16, .poly = 0x1021, .init = 0x0000, .reflect = true, .xorout = 0x0000 },
+    { .name = "crc16-modbus", .width = 16, .poly = 0x8005, .init = 0xFFFF, .reflect = true, .xorout = 0x0000 },
+    { .name = "crc16-x25", .width = 16, .poly = 0x1021, .init = 0xFFFF, .reflect = true, .xorout = 0xFFFF },
+    { .name = "crc32", .width = 32, .poly = 0x04C11DB7, .init = 0xFFFFFFFF, .reflect = true, .xorout = 0xFFFFFFFF },
+    { .name = "crc32c", .width = 32, .poly = 0x1EDC6F41, .init = 0xFFFFFFFF, .reflect = true, .xorout = 0xFFFFFFFF },
+    { .name = NULL },
+};
+
+#define CRC_CUSTOM_CACHE 8
+
+/* Recently used custom algorithms, replaced round robin */
+static crc_t crc_customs[CRC_CUSTOM_CACHE];
+static unsigned int crc_customs_next = 0;
+
+static uint32_t reflect_bits(uint32_t value, int width)
+{
+    uint32_t result = 0;
+
+    for (int i = 0; i < width; i++)
+    {
+        if (value & (1UL << i))
+        {
+            result |= 1UL << (width - 1 - i);
+        }
+    }
+
+    return result;
+}
+
+static uint32_t width_mask(int width)
+{
+    return width == 32 ? 0xFFFFFFFF : (1UL << width) - 1;
+}
+
+static void crc_table_build(crc_t *crc)
+{
+    uint32_t mask = width_mask(crc->width);
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t value;
+
+        if (crc->reflect)
+        {
+            uint32_t poly = reflect_bits(crc->poly, crc->width);
+
+            value = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? (value >> 1) ^ poly : value >> 1;
+            }
+        }
+        else
+        {
+            uint32_t top = 1UL << (crc->width - 1);
+
+            value = i << (crc->width - 8);
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & top) ? (value << 1) ^ crc->poly : value << 1;
+            }
+        }
+        crc->table[i] = value & mask;
+    }
+
+    crc->table_ready = true;
+}
+
+crc_t *crc_find(const char *name)
+{
+    for (crc_t *crc = crcs; crc->name != NULL; crc++)
+    {
+        if (strcmp(crc->name, name) == 0)
+        {
+            return crc;
+        }
+    }
+
+    return NULL;
+}
+
+/* Custom algorithm, cached with its lookup table so repeated computations
+ * with the same parameters do not rebuild the table */
+crc_t *crc_custom(int width, uint32_t poly, uint32_t init, bool reflect, uint32_t xorout)
+{
+    crc_t *crc;
+
+    for (int i = 0; i < CRC_CUSTOM_CACHE; i++)
+    {
+        crc = &crc_customs[i];
+        if ((crc->width == width) && (crc->poly == poly) && (crc->init == init) &&
+            (crc->reflect == reflect) && (crc->xorout == xorout))
+        {
+            return crc;
+        }
+    }
+
+    crc = &crc_customs[crc_customs_next];
+    crc_customs_next = (crc_customs_next + 1) % CRC_CUSTOM_CACHE;
+    *crc = (crc_t) { .name = "custom", .width = width, .poly = poly, .init = init,
+                     .reflect = reflect, .xorout = xorout };
+
+    return crc;
+}
+
+uint32_t crc_compute(crc_t *crc, const uint8_t *data, size_t len)
+{
+    uint32_t mask = width_mask(crc->width);
+    uint32_t value;
+
+    if (!crc->table_ready)
+    {
+        crc_table_build(crc);
+    }
+
+    if (crc->reflect)
+    {
+        value = reflect_bits(crc->init, crc->width);
+        for (size_t i = 0; i < len; i++)
+        {
+            value = (value >> 8) ^ crc->table[(value ^ data[i]) & 0xFF];
+        }
+    }
+    else
+    {
+        int shift = crc->width - 8;
+
+        value = crc->init;
+        for (size_t i = 0; i < len; i++)
+        {
+            value = (value << 8) ^ crc->table[((value >> shift) ^ data[i]) & 0xFF];
+        }
+    }
+
+    return (value ^ crc->xorout) & mask;
+}
@@ -0,0 +1,58 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Worst case encoded sizes */
+#define COBS_ENCODED_MAX(len) ((len) + (len) / 254 + 1)
+#define SLIP_ENCODED_MAX(len) (2 * (len) + 2)
+#define HDLC_ENCODED_MAX(len) (2 * (len) + 2)
+
+#define COBS_DELIMITER 0x00
+#define SLIP_END       0xC0
+#define HDLC_FLAG      0x7E
+
+typedef struct
+{
+    const char *name;
+    int width;              // 8, 16 or 32 bits
+    uint32_t poly;
+    uint32_t init;
+    bool reflect;           // Input and output reflected
+    uint32_t xorout;
+    uint32_t table[256];    // Lookup table, built on first use
+    bool table_ready;
+} crc_t;
+
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+ssize_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+size_t slip_encode(const uint8_t *in, size_t len, uint8_t *out);
+ssize_t slip_decode(const uint8_t *in, size_t len, uint8_t *out);
+size_t hdlc_encode(const uint8_t *in, size_t len, uint8_t *out);
+ssize_t hdlc_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+crc_t *crc_find(const char *name);
+crc_t *crc_custom(int width, uint32_t poly, uint32_t init, bool reflect, uint32_t xorout);
+uint32_t crc_compute(crc_t *crc, const uint8_t *data, size_t len);
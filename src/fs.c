@@ -21,7 +21,6 @@
 
 #define _GNU_SOURCE  // For statx()
 #include "config.h"
-#include <dirent.h>
 #include <fcntl.h>
 #include <regex.h>
 #include <stdarg.h>
@@ -110,88 +109,19 @@ bool fs_file_exists(const char *format, ...)
     return stat(filename, &st) == 0;
 }
 
-char* fs_search_directory(const char *dir_path, const char *dirname)
-{
-    struct dirent *entry;
-    char path[PATH_MAX];
-    struct stat st;
-    DIR *dir;
-
-    if ((dir = opendir(dir_path)) == NULL)
-    {
-        // Error opening directory
-        return NULL;
-    }
-
-    while ((entry = readdir(dir)) != NULL)
-    {
-        snprintf(path, PATH_MAX, "%s/%s", dir_path, entry->d_name);
-
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-        {
-            continue;
-        }
-
-        if (lstat(path, &st) == -1)
-        {
-            // Error getting directory status
-            closedir(dir);
-            return NULL;
-        }
-
-        if (S_ISLNK(st.st_mode))
-        {
-            // Skip symbolic links
-            continue;
-        }
-
-        if (S_ISDIR(st.st_mode))
-        {
-            // If it's a directory, check if it's the one we're looking for
-            if (strcmp(entry->d_name, dirname) == 0)
-            {
-                char *result = strndup(path, PATH_MAX);
-                closedir(dir);
-                return result;
-            }
-            else
-            {
-                // Recursively search within directories
-                char* result = fs_search_directory(path, dirname);
-                if (result != NULL)
-                {
-                    closedir(dir);
-                    return result;
-                }
-            }
-        }
-    }
-
-    closedir(dir);
-    return NULL;
-}
-
 #if defined(__linux__) && defined(STATX_BTIME)
 
 // Function to return creation time of file
 double fs_get_creation_time(const char *path)
 {
     struct statx stx;
-    int fd = open(path, O_RDONLY);
-    if (fd == -1)
-    {
-        return -1;
-    }
 
-    if (statx(fd, "", AT_EMPTY_PATH, STATX_ALL, &stx) != 0)
+    // Query by path, opening a tty device may block or have side effects
+    if (statx(AT_FDCWD, path, 0, STATX_BTIME, &stx) != 0)
     {
-        close(fd);
         return -1;
     }
 
-    // Close the file
-    close(fd);
-
     return stx.stx_btime.tv_sec + stx.stx_btime.tv_nsec / 1e9;
 }
 
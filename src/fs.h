@@ -26,6 +26,5 @@
 
 bool fs_dir_exists(const char *path);
 bool fs_file_exists(const char *format, ...);
-char* fs_search_directory(const char *dir_path, const char *dirname);
 ssize_t fs_read_file_stripped(char *buf, size_t bufsiz, const char *format, ...);
 double fs_get_creation_time(const char *path);
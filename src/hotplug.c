@@ -0,0 +1,551 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include "hotplug.h"
+#include "misc.h"
+
+#if defined(__linux__)
+
+#include <limits.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <linux/netlink.h>
+#include <glib.h>
+
+#define UEVENT_GROUP_KERNEL 1
+#define UEVENT_GROUP_UDEV 2
+#define UEVENT_BUFFER_SIZE 8192
+#define UDEV_MONITOR_MAGIC 0xfeedcafe
+
+/* Leading part of the header of udev messages, as sent by libudev */
+typedef struct
+{
+    char prefix[8];             // "libudev"
+    uint32_t magic;             // UDEV_MONITOR_MAGIC in network byte order
+    uint32_t header_size;
+    uint32_t properties_off;    // Offset of properties from start of message
+    uint32_t properties_len;
+} udev_header_t;
+
+/* Hotplug sources are multiplexed by an epoll instance so callers only need
+ * to wait for a single file descriptor. */
+static int epoll_fd = -1;
+static int uevent_fd = -1;
+static int inotify_fd = -1;
+static bool initialized = false;
+static double last_event_time = 0;
+
+#define WATCH_MAX 16 // Max. number of directories watched for a device path
+#define WATCH_HOPS 8 // Max. number of symbolic links followed
+#define WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_ATTRIB)
+
+/* Device path being watched. Each item watches a directory for the entry
+ * named next on the way to the device node. */
+static struct
+{
+    char *path;
+    int count;
+    struct
+    {
+        int wd;
+        char *dir;
+        char *name;
+    } items[WATCH_MAX];
+} watch;
+
+/* Subscribe to device add/remove events. When udev is running, its events
+ * are used since they are sent after device permissions and symlinks have
+ * been set up. Otherwise the raw kernel events are used.
+ */
+static void uevent_open(void)
+{
+    struct sockaddr_nl addr =
+    {
+        .nl_family = AF_NETLINK,
+        .nl_groups = UEVENT_GROUP_KERNEL,
+    };
+
+    if (access("/run/udev/control", F_OK) == 0)
+    {
+        addr.nl_groups = UEVENT_GROUP_UDEV;
+    }
+
+    uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (uevent_fd == -1)
+    {
+        return;
+    }
+
+    if (bind(uevent_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+    {
+        close(uevent_fd);
+        uevent_fd = -1;
+    }
+}
+
+static bool property_is(const char *property, size_t length, const char *expected)
+{
+    return (length == strlen(expected)) && (memcmp(property, expected, length) == 0);
+}
+
+/* Returns true if message announces a tty device being added or removed.
+ * Kernel messages are an ACTION@DEVPATH header followed by NUL separated
+ * KEY=value properties. Udev messages carry the same properties at the offset
+ * given by their binary header. Message must be NUL terminated.
+ */
+static bool uevent_is_tty(const char *buffer, size_t length)
+{
+    bool tty = false;
+    bool add_remove = false;
+    size_t i = 0;
+
+    if ((length >= sizeof(udev_header_t)) && (strcmp(buffer, "libudev") == 0))
+    {
+        udev_header_t header;
+
+        memcpy(&header, buffer, sizeof(header));
+        if ((ntohl(header.magic) != UDEV_MONITOR_MAGIC) ||
+            (header.properties_off > length) ||
+            (header.properties_len > length - header.properties_off))
+        {
+            return false;
+        }
+        i = header.properties_off;
+        length = header.properties_off + header.properties_len;
+    }
+    else if (memchr(buffer, '@', strnlen(buffer, length)) == NULL)
+    {
+        return false;
+    }
+
+    while (i < length)
+    {
+        const char *property = buffer + i;
+        size_t property_length = strnlen(property, length - i);
+
+        if (property_is(property, property_length, "SUBSYSTEM=tty"))
+        {
+            tty = true;
+        }
+        else if (property_is(property, property_length, "ACTION=add") ||
+                 property_is(property, property_length, "ACTION=remove"))
+        {
+            add_remove = true;
+        }
+
+        i += property_length + 1;
+    }
+
+    return tty && add_remove;
+}
+
+static void epoll_add(int fd)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int hotplug_fd(void)
+{
+    if (!initialized)
+    {
+        initialized = true;
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1)
+        {
+            return -1;
+        }
+
+        uevent_open();
+        if (uevent_fd != -1)
+        {
+            epoll_add(uevent_fd);
+        }
+
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd != -1)
+        {
+            epoll_add(inotify_fd);
+        }
+
+        if ((uevent_fd == -1) && (inotify_fd == -1))
+        {
+            close(epoll_fd);
+            epoll_fd = -1;
+        }
+    }
+
+    return epoll_fd;
+}
+
+static void watch_clear(void)
+{
+    for (int i = 0; i < watch.count; i++)
+    {
+        if (watch.items[i].wd != -1)
+        {
+            inotify_rm_watch(inotify_fd, watch.items[i].wd);
+        }
+        g_free(watch.items[i].dir);
+        g_free(watch.items[i].name);
+    }
+    watch.count = 0;
+
+    g_free(watch.path);
+    watch.path = NULL;
+}
+
+/* Watch directory of path for the path's last component to appear. Returns 1
+ * if a new watch was added, 0 if it already existed or -1 on error. */
+static int watch_add(const char *path)
+{
+    char *dir = g_path_get_dirname(path);
+    char *name = g_path_get_basename(path);
+    int i;
+
+    for (i = 0; i < watch.count; i++)
+    {
+        if ((strcmp(watch.items[i].dir, dir) == 0) && (strcmp(watch.items[i].name, name) == 0))
+        {
+            break;
+        }
+    }
+
+    if (i < watch.count)
+    {
+        if (watch.items[i].wd != -1)
+        {
+            g_free(dir);
+            g_free(name);
+            return 0;
+        }
+        g_free(watch.items[i].dir);
+        g_free(watch.items[i].name);
+    }
+    else if (watch.count < WATCH_MAX)
+    {
+        watch.count++;
+    }
+    else
+    {
+        g_free(dir);
+        g_free(name);
+        return -1;
+    }
+
+    watch.items[i].dir = dir;
+    watch.items[i].name = name;
+    watch.items[i].wd = inotify_add_watch(inotify_fd, dir, WATCH_MASK);
+
+    return (watch.items[i].wd == -1) ? -1 : 1;
+}
+
+/* Watch the way to device path so hotplug_handle() reports when the device
+ * node appears or its permissions change. Missing parent directories (e.g.
+ * /dev/serial/by-id before the first device is plugged in) are watched
+ * through their closest existing ancestor and dangling symbolic links
+ * through their target. Call again after each reported event to follow
+ * newly created directories.
+ *
+ * Returns 1 if new watches were added, in which case the path should be
+ * checked again before waiting, 0 if the path is watched and tty hotplug
+ * events are available, or -1 if waiting requires polling. */
+int hotplug_watch(const char *path)
+{
+    struct stat st;
+    int added = 0;
+    int status;
+
+    if ((hotplug_fd() == -1) || (inotify_fd == -1) || (path == NULL))
+    {
+        return -1;
+    }
+
+    if ((watch.path == NULL) || (strcmp(watch.path, path) != 0))
+    {
+        watch_clear();
+        watch.path = g_strdup(path);
+    }
+
+    char *current = g_strdup(path);
+
+    for (int hops = 0; hops < WATCH_HOPS; hops++)
+    {
+        if (lstat(current, &st) == 0)
+        {
+            // Watch existing entry for replacement and permission changes
+            status = watch_add(current);
+            if (status < 0)
+            {
+                break;
+            }
+            added |= status;
+
+            // Follow dangling symbolic link to its target
+            char target[PATH_MAX];
+            ssize_t length;
+            if ((!S_ISLNK(st.st_mode)) || (stat(current, &st) == 0) ||
+                ((length = readlink(current, target, sizeof(target) - 1)) == -1))
+            {
+                break;
+            }
+            target[length] = '\0';
+
+            char *next;
+            if (target[0] == '/')
+            {
+                next = g_strdup(target);
+            }
+            else
+            {
+                char *dir = g_path_get_dirname(current);
+                next = g_build_filename(dir, target, NULL);
+                g_free(dir);
+            }
+            g_free(current);
+            current = next;
+            continue;
+        }
+
+        // Watch closest existing ancestor for next missing component
+        char *child = g_strdup(current);
+        char *parent = g_path_get_dirname(child);
+        while ((lstat(parent, &st) != 0) && (strcmp(parent, child) != 0))
+        {
+            g_free(child);
+            child = parent;
+            parent = g_path_get_dirname(child);
+        }
+        g_free(parent);
+        status = watch_add(child);
+        g_free(child);
+        if (status >= 0)
+        {
+            added |= status;
+        }
+        break;
+    }
+
+    g_free(current);
+
+    if (added)
+    {
+        return 1;
+    }
+
+    return (uevent_fd == -1) ? -1 : 0;
+}
+
+static bool inotify_handle(void)
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *ptr = buffer; ptr < buffer + length; )
+        {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                changed = true;
+            }
+
+            for (int i = 0; i < watch.count; i++)
+            {
+                if (event->wd != watch.items[i].wd)
+                {
+                    continue;
+                }
+
+                if (event->mask & IN_IGNORED)
+                {
+                    // Watched directory was removed
+                    watch.items[i].wd = -1;
+                    changed = true;
+                }
+                else if ((event->len > 0) && (strcmp(event->name, watch.items[i].name) == 0))
+                {
+                    changed = true;
+                }
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+static bool uevent_handle(void)
+{
+    char buffer[UEVENT_BUFFER_SIZE];
+    bool changed = false;
+    ssize_t length;
+
+    // Drain all pending messages
+    while (true)
+    {
+        length = recv(uevent_fd, buffer, sizeof(buffer) - 1, 0);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == ENOBUFS)
+            {
+                // Messages were lost, assume one of them was for a tty
+                changed = true;
+                continue;
+            }
+            break;
+        }
+
+        buffer[length] = '\0';
+
+        if (uevent_is_tty(buffer, length))
+        {
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool hotplug_handle(void)
+{
+    bool changed = false;
+
+    if (hotplug_fd() == -1)
+    {
+        return false;
+    }
+
+    if ((uevent_fd != -1) && uevent_handle())
+    {
+        changed = true;
+    }
+
+    if ((inotify_fd != -1) && inotify_handle())
+    {
+        changed = true;
+    }
+
+    if (changed)
+    {
+        last_event_time = get_current_time();
+    }
+
+    return changed;
+}
+
+double hotplug_last_event_time(void)
+{
+    return last_event_time;
+}
+
+#else
+
+int hotplug_fd(void)
+{
+    return -1;
+}
+
+int hotplug_watch(const char *path)
+{
+    UNUSED(path);
+    return -1;
+}
+
+bool hotplug_handle(void)
+{
+    return false;
+}
+
+double hotplug_last_event_time(void)
+{
+    return 0;
+}
+
+#endif
+
+static long elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Wait up to timeout ms for a tty device to be added or removed, or for the
+ * watched device node to appear. Returns true if such an event was received. Without hotplug support this simply sleeps.
+ */
+bool hotplug_wait(int timeout)
+{
+    struct timespec start;
+    long remaining = timeout;
+    int fd = hotplug_fd();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (fd == -1)
+    {
+        usleep(timeout * 1000);
+        return false;
+    }
+
+    while (remaining > 0)
+    {
+        struct pollfd fds = { .fd = fd, .events = POLLIN };
+
+        int status = poll(&fds, 1, remaining);
+        if ((status > 0) && hotplug_handle())
+        {
+            return true;
+        }
+        if ((status < 0) && (errno != EINTR))
+        {
+            usleep(remaining * 1000);
+            return false;
+        }
+
+        remaining = timeout - elapsed_ms(&start);
+    }
+
+    return false;
+}
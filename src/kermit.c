@@ -0,0 +1,1290 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Kermit file transfer protocol (single file send and receive) with the
+ * long packet, sliding window and streaming extensions.
+ *
+ * Reference: Frank da Cruz, "Kermit Protocol Manual", 6th edition.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <libgen.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "kermit.h"
+#include "xymodem.h"
+#include "options.h"
+#include "print.h"
+#include "misc.h"
+#include "progress.h"
+
+#define MARK            0x01        /* Start of packet (SOH) */
+#define QCTL            '#'         /* Control character prefix */
+#define QBIN            '&'         /* 8th bit prefix */
+#define REPT            '~'         /* Repeat count prefix */
+
+#define KERMIT_MAXL     9024        /* Max. long packet length we accept */
+#define KERMIT_WINDOW   31          /* Max. sliding window size */
+#define KERMIT_TIMEOUT  5           /* Default packet timeout [s] */
+#define KERMIT_RETRIES  10
+#define KERMIT_CHKT     3           /* Best block check type we offer */
+
+#define SLOTS           32          /* Power of two > KERMIT_WINDOW */
+
+/* Capabilities (CAPAS) and WHATAMI bits of send-init parameters */
+#define CAPA_LONG       2
+#define CAPA_SWIN       4
+#define CAPA_ATTR       8
+#define WMI_STREAM      8
+#define WMI_FLAG        32
+
+#define tochar(x)       ((char) ((x) + 32))
+#define unchar(x)       ((int) (uint8_t) (x) - 32)
+#define ctl(x)          ((x) ^ 64)
+
+#define OK              0
+#define ERR             (-1)
+#define BAD             (-2)
+
+typedef struct
+{
+    char type;
+    int seq;
+    int len;
+    char data[KERMIT_MAXL];
+} packet_t;
+
+typedef struct
+{
+    bool used;
+    char type;
+    int len;
+    char data[KERMIT_MAXL];
+} slot_t;
+
+/* Negotiated session parameters and statistics */
+static struct
+{
+    int sio;
+    int maxl;               /* Max. packet length peer accepts */
+    int timeout;            /* Packet timeout [ms] */
+    int npad;
+    char padc;
+    char eol;
+    char qctl;              /* Control prefix used by peer */
+    char ebq;               /* 8th bit prefix, 0 if not used */
+    char rptq;              /* Repeat prefix, 0 if not used */
+    int chkt;               /* Block check type (1-3) */
+    int window;
+    bool attributes;
+    bool streaming;
+    unsigned long seq;      /* Absolute sequence number */
+    unsigned long retries;
+} k;
+
+/* Buffered device input */
+static struct
+{
+    uint8_t data[4096];
+    int len;
+    int pos;
+} rx;
+
+static void session_reset(int sio)
+{
+    memset(&k, 0, sizeof(k));
+    k.sio = sio;
+    k.maxl = 80;
+    k.timeout = KERMIT_TIMEOUT * 1000;
+    k.eol = '\r';
+    k.qctl = QCTL;
+    k.chkt = 1;
+    k.window = 1;
+    rx.len = rx.pos = 0;
+}
+
+/* Only stream when the link is considered reliable */
+static bool link_reliable(void)
+{
+    return option.flow == FLOW_HARD;
+}
+
+static bool link_7bit(void)
+{
+    return (option.databits < 8) || (option.parity != PARITY_NONE);
+}
+
+static uint16_t crc16_kermit(const uint8_t *data, int len)
+{
+    uint16_t crc = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+
+    return crc;
+}
+
+static int block_check(const uint8_t *data, int len, int type, char *check)
+{
+    unsigned int sum = 0;
+
+    if (type == 3)
+    {
+        uint16_t crc = crc16_kermit(data, len);
+
+        check[0] = tochar((crc >> 12) & 0x0f);
+        check[1] = tochar((crc >> 6) & 0x3f);
+        check[2] = tochar(crc & 0x3f);
+        return 3;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        sum += data[i];
+    }
+
+    if (type == 2)
+    {
+        sum &= 07777;
+        check[0] = tochar((sum >> 6) & 0x3f);
+        check[1] = tochar(sum & 0x3f);
+        return 2;
+    }
+
+    check[0] = tochar((sum + ((sum & 0300) >> 6)) & 0x3f);
+    return 1;
+}
+
+static int write_all(const char *data, int len)
+{
+    struct pollfd fds = { .fd = k.sio, .events = POLLOUT };
+
+    while (len > 0)
+    {
+        ssize_t rc = write(k.sio, data, len);
+        if (rc < 0)
+        {
+            if ((errno != EAGAIN) && (errno != EINTR))
+            {
+                tio_error_print("Write to serial failed (%s)", strerror(errno));
+                return ERR;
+            }
+            poll(&fds, 1, k.timeout);
+            continue;
+        }
+        data += rc;
+        len -= rc;
+    }
+
+    return OK;
+}
+
+/* Packets of the S exchange always use block check type 1 */
+static int check_type(char type)
+{
+    return (type == 'S') ? 1 : k.chkt;
+}
+
+static int packet_send(char type, int seq, const char *data, int len)
+{
+    char buffer[KERMIT_MAXL + 32];
+    char *p = buffer;
+    int chk = check_type(type);
+    int hdr;
+
+    for (int i = 0; i < k.npad; i++)
+    {
+        *p++ = k.padc;
+    }
+    hdr = p - buffer;
+
+    *p++ = MARK;
+    if (len + 2 + chk > 94)
+    {
+        int x = len + chk;
+        unsigned int sum = 0;
+
+        *p++ = tochar(0);
+        *p++ = tochar(seq & 63);
+        *p++ = type;
+        *p++ = tochar(x / 95);
+        *p++ = tochar(x % 95);
+        for (int i = hdr + 1; i < hdr + 6; i++)
+        {
+            sum += (uint8_t) buffer[i];
+        }
+        *p++ = tochar((sum + ((sum & 0300) >> 6)) & 0x3f);
+    }
+    else
+    {
+        *p++ = tochar(len + 2 + chk);
+        *p++ = tochar(seq & 63);
+        *p++ = type;
+    }
+    if (len > 0)
+    {
+        memcpy(p, data, len);
+        p += len;
+    }
+    p += block_check((uint8_t *) buffer + hdr + 1, p - buffer - hdr - 1, chk, p);
+    *p++ = k.eol;
+
+    return write_all(buffer, p - buffer);
+}
+
+static int packet_send_string(char type, int seq, const char *string)
+{
+    return packet_send(type, seq, string, strlen(string));
+}
+
+/* Read one byte, waiting until deadline. Returns 0 on timeout. */
+static int rx_byte(uint8_t *c, double deadline)
+{
+    while (rx.pos == rx.len)
+    {
+        int remaining = (deadline - get_current_time()) * 1000;
+        int rc;
+
+        if (key_hit)
+        {
+            return ERR;
+        }
+        rc = read_poll(k.sio, rx.data, sizeof(rx.data), remaining < 0 ? 0 : (remaining < 50 ? remaining : 50));
+        if (rc < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR))
+            {
+                continue;
+            }
+            tio_error_print("Read from serial failed");
+            return ERR;
+        }
+        if ((rc == 0) && (remaining <= 0))
+        {
+            return 0;
+        }
+        rx.len = rc;
+        rx.pos = 0;
+    }
+
+    *c = rx.data[rx.pos++];
+    return 1;
+}
+
+/* Receive next packet. Returns 1 on success, 0 on timeout, BAD on corrupt
+ * packet or ERR on error.
+ */
+static int packet_receive(packet_t *packet, int timeout)
+{
+    double deadline = get_current_time() + timeout / 1000.0;
+    uint8_t buffer[KERMIT_MAXL + 8];
+    char check[3];
+    uint8_t c;
+    int n, len, chk, rc;
+
+restart:
+    do
+    {
+        if ((rc = rx_byte(&c, deadline)) <= 0)
+        {
+            return rc;
+        }
+    } while (c != MARK);
+
+    /* LEN, SEQ, TYPE */
+    for (n = 0; n < 3; n++)
+    {
+        if ((rc = rx_byte(&buffer[n], deadline)) <= 0)
+        {
+            return rc;
+        }
+        if (buffer[n] == MARK)
+        {
+            goto restart;
+        }
+    }
+
+    packet->seq = unchar(buffer[1]);
+    packet->type = buffer[2];
+    chk = check_type(packet->type);
+
+    if (unchar(buffer[0]) == 0)
+    {
+        unsigned int sum = 0;
+
+        /* Extended header: LENX1, LENX2, HCHECK */
+        for (; n < 6; n++)
+        {
+            if ((rc = rx_byte(&buffer[n], deadline)) <= 0)
+            {
+                return rc;
+            }
+            if (buffer[n] == MARK)
+            {
+                goto restart;
+            }
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            sum += buffer[i];
+        }
+        if (buffer[5] != (uint8_t) tochar((sum + ((sum & 0300) >> 6)) & 0x3f))
+        {
+            return BAD;
+        }
+        len = unchar(buffer[3]) * 95 + unchar(buffer[4]);
+    }
+    else
+    {
+        len = unchar(buffer[0]) - 2;
+    }
+
+    if ((len < chk) || (len > KERMIT_MAXL))
+    {
+        return BAD;
+    }
+
+    for (int i = 0; i < len; i++, n++)
+    {
+        if ((rc = rx_byte(&buffer[n], deadline)) <= 0)
+        {
+            return rc;
+        }
+        if (buffer[n] == MARK)
+        {
+            goto restart;
+        }
+    }
+
+    block_check(buffer, n - chk, chk, check);
+    if (memcmp(check, buffer + n - chk, chk) != 0)
+    {
+        return BAD;
+    }
+
+    packet->len = len - chk;
+    memcpy(packet->data, buffer + n - len, packet->len);
+    packet->data[packet->len] = 0;
+
+    return 1;
+}
+
+/* Encode data into at most size characters. Returns number of source bytes
+ * consumed and stores encoded length in *length.
+ */
+static size_t encode(const uint8_t *data, size_t len, char *out, int size, int *length)
+{
+    size_t i = 0;
+    int n = 0;
+
+    while (i < len)
+    {
+        uint8_t c = data[i];
+        char code[5];
+        int count = 1;
+        int t = 0;
+        uint8_t a;
+
+        if (k.rptq)
+        {
+            while ((i + count < len) && (data[i + count] == c) && (count < 94))
+            {
+                count++;
+            }
+            if (count > 2)
+            {
+                code[t++] = k.rptq;
+                code[t++] = tochar(count);
+            }
+            else
+            {
+                count = 1;
+            }
+        }
+        if (k.ebq && (c & 0x80))
+        {
+            code[t++] = k.ebq;
+            c &= 0x7f;
+        }
+        a = c & 0x7f;
+        if ((a < 32) || (a == 127))
+        {
+            code[t++] = QCTL;
+            c = ctl(c);
+        }
+        else if ((a == QCTL) || (k.ebq && a == k.ebq) || (k.rptq && a == k.rptq))
+        {
+            code[t++] = QCTL;
+        }
+        code[t++] = c;
+
+        if (n + t > size)
+        {
+            break;
+        }
+        memcpy(out + n, code, t);
+        n += t;
+        i += count;
+    }
+
+    *length = n;
+    return i;
+}
+
+/* Decode data into at most size bytes. Returns number of decoded bytes and
+ * stores number of characters consumed in *consumed.
+ */
+static int decode(const char *data, int len, int *consumed, uint8_t *out, int size)
+{
+    int i = *consumed;
+    int n = 0;
+
+    while ((i < len) && (n + 94 <= size))
+    {
+        uint8_t c = data[i++];
+        uint8_t bit8 = 0;
+        int count = 1;
+
+        if (k.rptq && (c == k.rptq) && (i + 1 < len))
+        {
+            count = unchar(data[i++]);
+            c = data[i++];
+        }
+        if (k.ebq && (c == k.ebq) && (i < len))
+        {
+            bit8 = 0x80;
+            c = data[i++];
+        }
+        if ((c == k.qctl) && (i < len))
+        {
+            uint8_t a;
+
+            c = data[i++];
+            a = c & 0x7f;
+            if ((a == 077) || ((a >= 0100) && (a <= 0137)))
+            {
+                c = ctl(c);
+            }
+        }
+        c |= bit8;
+
+        while (count-- > 0)
+        {
+            out[n++] = c;
+        }
+    }
+
+    *consumed = i;
+    return n;
+}
+
+static void decode_string(const char *data, int len, char *out, int size)
+{
+    int consumed = 0;
+    uint8_t buffer[KERMIT_MAXL + 94];
+    int n = decode(data, len, &consumed, buffer, sizeof(buffer));
+
+    n = n < size - 1 ? n : size - 1;
+    memcpy(out, buffer, n);
+    out[n] = 0;
+}
+
+static int decode_write(int fd, const char *data, int len)
+{
+    uint8_t buffer[4096];
+    int consumed = 0;
+
+    while (consumed < len)
+    {
+        int n = decode(data, len, &consumed, buffer, sizeof(buffer));
+
+        if (write(fd, buffer, n) != n)
+        {
+            tio_error_print("Write to file failed (%s)", strerror(errno));
+            return ERR;
+        }
+        progress_update(n, k.retries);
+    }
+
+    return OK;
+}
+
+static int params_build(char *data)
+{
+    int n = 0;
+
+    data[n++] = tochar(94);
+    data[n++] = tochar(KERMIT_TIMEOUT);
+    data[n++] = tochar(0);
+    data[n++] = ctl(0);
+    data[n++] = tochar('\r');
+    data[n++] = QCTL;
+    data[n++] = link_7bit() ? QBIN : 'Y';
+    data[n++] = '0' + KERMIT_CHKT;
+    data[n++] = REPT;
+    data[n++] = tochar(CAPA_LONG | CAPA_SWIN | CAPA_ATTR);
+    data[n++] = tochar(KERMIT_WINDOW);
+    data[n++] = tochar(KERMIT_MAXL / 95);
+    data[n++] = tochar(KERMIT_MAXL % 95);
+    /* No checkpointing */
+    data[n++] = tochar(0);
+    data[n++] = tochar(0);
+    data[n++] = tochar(0);
+    data[n++] = tochar(0);
+    data[n++] = tochar(WMI_FLAG | (link_reliable() ? WMI_STREAM : 0));
+
+    return n;
+}
+
+static bool is_prefix(char c)
+{
+    return ((c > 32) && (c < 63)) || ((c > 95) && (c < 127));
+}
+
+/* Negotiate session parameters from peer send-init parameters */
+static void params_parse(const char *data, int len)
+{
+    char ours = link_7bit() ? QBIN : 'Y';
+    char theirs = len > 6 ? data[6] : 'N';
+    int capas = 0;
+    int i = 9;
+
+    if ((len > 0) && (unchar(data[0]) > 10))
+    {
+        k.maxl = unchar(data[0]);
+    }
+    if ((len > 1) && (unchar(data[1]) > 0))
+    {
+        k.timeout = unchar(data[1]) * 1000;
+    }
+    if (len > 2)
+    {
+        k.npad = unchar(data[2]);
+    }
+    if (len > 3)
+    {
+        k.padc = ctl(data[3]);
+    }
+    if ((len > 4) && (unchar(data[4]) > 0))
+    {
+        k.eol = unchar(data[4]);
+    }
+    if ((len > 5) && (data[5] != ' '))
+    {
+        k.qctl = data[5];
+    }
+
+    k.ebq = 0;
+    if (is_prefix(ours) && ((theirs == 'Y') || (theirs == ours)))
+    {
+        k.ebq = ours;
+    }
+    else if (is_prefix(theirs) && (ours == 'Y'))
+    {
+        k.ebq = theirs;
+    }
+
+    /* Use the lower of the offered block check types */
+    k.chkt = 1;
+    if ((len > 7) && (data[7] >= '1') && (data[7] <= '3'))
+    {
+        k.chkt = data[7] - '0';
+        if (k.chkt > KERMIT_CHKT)
+        {
+            k.chkt = KERMIT_CHKT;
+        }
+    }
+    k.rptq = ((len > 8) && (data[8] == REPT)) ? REPT : 0;
+
+    if (len > i)
+    {
+        capas = unchar(data[i]);
+        while ((i < len) && (unchar(data[i]) & 1))
+        {
+            i++;
+        }
+    }
+
+    if ((capas & CAPA_SWIN) && (len > i + 1))
+    {
+        int window = unchar(data[i + 1]);
+        k.window = window < 1 ? 1 : (window > KERMIT_WINDOW ? KERMIT_WINDOW : window);
+    }
+    if (capas & CAPA_LONG)
+    {
+        int maxl = 500;
+        if (len > i + 3)
+        {
+            maxl = unchar(data[i + 2]) * 95 + unchar(data[i + 3]);
+        }
+        k.maxl = maxl > KERMIT_MAXL ? KERMIT_MAXL : (maxl < 10 ? 500 : maxl);
+    }
+    k.attributes = capas & CAPA_ATTR;
+    k.streaming = link_reliable() && (len > i + 8) &&
+                  ((unchar(data[i + 8]) & (WMI_FLAG | WMI_STREAM)) == (WMI_FLAG | WMI_STREAM));
+}
+
+/* Max. number of encoded data characters per packet */
+static int data_size(void)
+{
+    return (k.maxl > 94 ? k.maxl - 6 : k.maxl - 2) - k.chkt;
+}
+
+static void print_error_packet(const packet_t *packet)
+{
+    char message[256];
+
+    decode_string(packet->data, packet->len, message, sizeof(message));
+    tio_error_print("Kermit error from remote: %s", message);
+}
+
+static void summary(void)
+{
+    progress_finish(k.retries, ", packet length %d, window %d%s", k.maxl, k.window,
+                    k.streaming ? " (streaming)" : "");
+}
+
+/* Send packet and wait for its acknowledgement (stop and wait) */
+static int transact(char type, const char *data, int len, packet_t *reply)
+{
+    int seq = k.seq & 63;
+    int retries = 0;
+
+    if (packet_send(type, seq, data, len) < 0)
+    {
+        return ERR;
+    }
+
+    while (1)
+    {
+        int rc = packet_receive(reply, k.timeout);
+
+        if (rc == ERR)
+        {
+            return ERR;
+        }
+        if (rc == 1)
+        {
+            if ((reply->type == 'Y') && (reply->seq == seq))
+            {
+                k.seq++;
+                return OK;
+            }
+            if ((reply->type == 'N') && (reply->seq == ((seq + 1) & 63)) && (type != 'S'))
+            {
+                /* NAK for next packet implies ACK */
+                reply->len = 0;
+                k.seq++;
+                return OK;
+            }
+            if (reply->type == 'E')
+            {
+                print_error_packet(reply);
+                return ERR;
+            }
+            if (reply->type != 'N')
+            {
+                /* Ignore stale acknowledgements */
+                continue;
+            }
+        }
+
+        if (++retries > KERMIT_RETRIES)
+        {
+            tio_error_print("Too many retries");
+            return ERR;
+        }
+        k.retries++;
+        if (packet_send(type, seq, data, len) < 0)
+        {
+            return ERR;
+        }
+    }
+}
+
+/* Send file data in D packets using sliding window or streaming */
+static int send_data(const uint8_t *data, size_t size, packet_t *reply)
+{
+    slot_t *slots = calloc(SLOTS, sizeof(slot_t));
+    int retries[SLOTS] = {};
+    bool resent[SLOTS] = {};
+    unsigned long base = k.seq, next = k.seq;
+    size_t offset = 0;
+    int size_max = data_size();
+    int rc = ERR;
+
+    if (slots == NULL)
+    {
+        tio_error_print("Out of memory");
+        return ERR;
+    }
+
+    while ((offset < size) || (base < next))
+    {
+        unsigned long i;
+        int received;
+
+        if (key_hit)
+        {
+            goto out;
+        }
+
+        /* Fill window */
+        while ((offset < size) && (k.streaming || (next - base < (unsigned long) k.window)))
+        {
+            slot_t *slot = &slots[next % SLOTS];
+            size_t consumed = encode(data + offset, size - offset, slot->data, size_max, &slot->len);
+
+            offset += consumed;
+            progress_update(consumed, k.retries);
+            slot->used = true;
+            retries[next % SLOTS] = 0;
+            resent[next % SLOTS] = false;
+            if (packet_send('D', next & 63, slot->data, slot->len) < 0)
+            {
+                goto out;
+            }
+            next++;
+
+            if (k.streaming)
+            {
+                /* Acknowledgements are not sent while streaming */
+                base = next;
+                break;
+            }
+        }
+
+        received = packet_receive(reply, (k.streaming || base == next) ? 0 : k.timeout);
+        if (received == ERR)
+        {
+            goto out;
+        }
+
+        if (received == 1)
+        {
+            if (reply->type == 'E')
+            {
+                print_error_packet(reply);
+                goto out;
+            }
+            if (k.streaming)
+            {
+                if (reply->type == 'N')
+                {
+                    tio_error_print("Packet lost while streaming");
+                    goto out;
+                }
+                continue;
+            }
+
+            for (i = base; i < next; i++)
+            {
+                if ((i & 63) == (unsigned long) reply->seq)
+                {
+                    break;
+                }
+            }
+
+            if (reply->type == 'Y')
+            {
+                if ((reply->len > 0) && ((reply->data[0] == 'X') || (reply->data[0] == 'Z')))
+                {
+                    tio_error_print("Transfer cancelled by remote");
+                    goto out;
+                }
+                if (i < next)
+                {
+                    slots[i % SLOTS].used = false;
+
+                    /* Window blocked by oldest packet, its ACK is likely lost */
+                    if ((i != base) && slots[base % SLOTS].used && !resent[base % SLOTS] &&
+                        (next - base == (unsigned long) k.window))
+                    {
+                        resent[base % SLOTS] = true;
+                        k.retries++;
+                        if (packet_send('D', base & 63, slots[base % SLOTS].data, slots[base % SLOTS].len) < 0)
+                        {
+                            goto out;
+                        }
+                    }
+                }
+            }
+            else if (reply->type == 'N')
+            {
+                if (i < next)
+                {
+                    if (++retries[i % SLOTS] > KERMIT_RETRIES)
+                    {
+                        tio_error_print("Too many retries");
+                        goto out;
+                    }
+                    k.retries++;
+                    if (packet_send('D', i & 63, slots[i % SLOTS].data, slots[i % SLOTS].len) < 0)
+                    {
+                        goto out;
+                    }
+                }
+                else if ((unsigned long) reply->seq == (next & 63))
+                {
+                    /* NAK for next packet implies ACK of all outstanding */
+                    for (i = base; i < next; i++)
+                    {
+                        slots[i % SLOTS].used = false;
+                    }
+                }
+            }
+
+            while ((base < next) && !slots[base % SLOTS].used)
+            {
+                base++;
+            }
+        }
+        else if (received == 0 && k.streaming)
+        {
+            continue;
+        }
+        else if (base < next)
+        {
+            /* Timeout or corrupt packet, retransmit oldest outstanding */
+            if (++retries[base % SLOTS] > KERMIT_RETRIES)
+            {
+                tio_error_print("Too many retries");
+                goto out;
+            }
+            k.retries++;
+            if (packet_send('D', base & 63, slots[base % SLOTS].data, slots[base % SLOTS].len) < 0)
+            {
+                goto out;
+            }
+        }
+    }
+
+    k.seq = next;
+    rc = OK;
+
+out:
+    free(slots);
+    return rc;
+}
+
+static int send_file(const char *filename, const uint8_t *data, size_t size)
+{
+    packet_t *reply = malloc(sizeof(packet_t));
+    char *buffer = malloc(KERMIT_MAXL);
+    char *name = strdup(filename);
+    char *base;
+    int len;
+    int rc = ERR;
+
+    if ((reply == NULL) || (buffer == NULL) || (name == NULL))
+    {
+        tio_error_print("Out of memory");
+        goto out;
+    }
+
+    /* Send-init */
+    len = params_build(buffer);
+    if (transact('S', buffer, len, reply) < 0)
+    {
+        goto out;
+    }
+    params_parse(reply->data, reply->len);
+
+    /* File header */
+    base = basename(name);
+    encode((uint8_t *) base, strlen(base), buffer, data_size(), &len);
+    if (transact('F', buffer, len, reply) < 0)
+    {
+        goto out;
+    }
+
+    /* File attributes */
+    if (k.attributes)
+    {
+        char length[32];
+
+        snprintf(length, sizeof(length), "%zu", size);
+        len = snprintf(buffer, KERMIT_MAXL, "1%c%s", tochar(strlen(length)), length);
+        if (transact('A', buffer, len, reply) < 0)
+        {
+            goto out;
+        }
+        if ((reply->len > 0) && (reply->data[0] == 'N'))
+        {
+            tio_error_print("File refused by remote");
+            goto out;
+        }
+    }
+
+    if (send_data(data, size, reply) < 0)
+    {
+        goto out;
+    }
+
+    /* End of file and end of transaction */
+    if (transact('Z', NULL, 0, reply) < 0)
+    {
+        goto out;
+    }
+    if (transact('B', NULL, 0, reply) < 0)
+    {
+        goto out;
+    }
+
+    rc = OK;
+
+out:
+    free(name);
+    free(buffer);
+    free(reply);
+    return rc;
+}
+
+int kermit_send(int sio, const char *filename)
+{
+    struct stat st;
+    uint8_t *data = NULL;
+    int fd, rc;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        tio_error_print("Could not open file");
+        return ERR;
+    }
+    fstat(fd, &st);
+
+    if (st.st_size > 0)
+    {
+        data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            tio_error_print("Could not mmap file");
+            close(fd);
+            return ERR;
+        }
+    }
+
+    session_reset(sio);
+    progress_start(st.st_size);
+    key_hit = 0;
+
+    rc = send_file(filename, data, st.st_size);
+    if ((rc < 0) && key_hit)
+    {
+        packet_send_string('E', k.seq & 63, "Cancelled by user");
+    }
+    summary();
+
+    key_hit = 0xff;
+
+    if (data != NULL)
+    {
+        munmap(data, st.st_size);
+    }
+    close(fd);
+    tcflush(sio, TCIOFLUSH);
+
+    return rc;
+}
+
+/* Process in-sequence packet. Returns 1 when transaction is complete. */
+static int receive_process(int fd, slot_t *slot, int seq)
+{
+    char buffer[256];
+
+    switch (slot->type)
+    {
+        case 'D':
+            if (decode_write(fd, slot->data, slot->len) < 0)
+            {
+                packet_send_string('E', seq, "Write failed");
+                return ERR;
+            }
+            return 0;
+
+        case 'F':
+            decode_string(slot->data, slot->len, buffer, sizeof(buffer));
+            tio_printf("Receiving '%s'", buffer);
+            break;
+
+        case 'A':
+            for (int i = 0; i + 1 < slot->len; )
+            {
+                int len = unchar(slot->data[i + 1]);
+
+                if ((slot->data[i] == '1') && (len < 32) && (i + 2 + len <= slot->len))
+                {
+                    char length[32];
+
+                    memcpy(length, slot->data + i + 2, len);
+                    length[len] = 0;
+                    progress_set_total(strtoul(length, NULL, 10));
+                }
+                i += 2 + len;
+            }
+            break;
+
+        case 'Z':
+            if ((slot->len > 0) && (slot->data[0] == 'D'))
+            {
+                tio_error_print("File discarded by remote");
+                packet_send('Y', seq, NULL, 0);
+                return ERR;
+            }
+            break;
+
+        case 'B':
+            packet_send('Y', seq, NULL, 0);
+            return 1;
+
+        default:
+            packet_send_string('E', seq, "Unexpected packet type");
+            tio_error_print("Unexpected packet type '%c'", slot->type);
+            return ERR;
+    }
+
+    if (packet_send('Y', seq, NULL, 0) < 0)
+    {
+        return ERR;
+    }
+
+    return 0;
+}
+
+static int receive_file(int fd)
+{
+    slot_t *slots = calloc(SLOTS, sizeof(slot_t));
+    packet_t *packet = malloc(sizeof(packet_t));
+    char params[32];
+    int params_len = params_build(params);
+    unsigned long base, top;
+    bool nak_sent = false;
+    int retries = 0;
+    int rc = ERR;
+
+    if ((slots == NULL) || (packet == NULL))
+    {
+        tio_error_print("Out of memory");
+        goto out;
+    }
+
+    /* Wait for send-init */
+    while (1)
+    {
+        int received = packet_receive(packet, k.timeout);
+
+        if (received == ERR)
+        {
+            goto out;
+        }
+        if ((received == 1) && (packet->type == 'S'))
+        {
+            break;
+        }
+        if ((received == 1) && (packet->type == 'E'))
+        {
+            print_error_packet(packet);
+            goto out;
+        }
+        if (++retries > KERMIT_RETRIES)
+        {
+            tio_error_print("Timeout waiting for sender");
+            goto out;
+        }
+        packet_send('N', 0, NULL, 0);
+    }
+
+    /* Acknowledge with our parameters using block check type 1 */
+    if (packet_send('Y', packet->seq, params, params_len) < 0)
+    {
+        goto out;
+    }
+    params_parse(packet->data, packet->len);
+    base = top = packet->seq + 1;
+
+    /* Measure throughput from start of transfer */
+    progress_start(0);
+
+    retries = 0;
+    while (1)
+    {
+        int received = packet_receive(packet, k.timeout);
+        unsigned long offset;
+        slot_t *slot;
+
+        if (received == ERR)
+        {
+            goto out;
+        }
+
+        if ((received == BAD) && (k.window > 1))
+        {
+            /* Lost packets are requested once a later packet arrives, but a
+             * corrupted retransmission of the oldest missing packet is only
+             * detected here.
+             */
+            if ((top > base) && !nak_sent)
+            {
+                packet_send('N', base & 63, NULL, 0);
+                nak_sent = true;
+            }
+            continue;
+        }
+        if (received != 1)
+        {
+            if (++retries > KERMIT_RETRIES)
+            {
+                tio_error_print("Too many retries");
+                goto out;
+            }
+            k.retries++;
+            packet_send('N', base & 63, NULL, 0);
+            continue;
+        }
+        retries = 0;
+
+        if (packet->type == 'E')
+        {
+            print_error_packet(packet);
+            goto out;
+        }
+
+        offset = (packet->seq - base) & 63;
+        if (offset >= (unsigned long) k.window)
+        {
+            /* Duplicate of packet already received, acknowledge again */
+            if (packet->type == 'S')
+            {
+                int chkt = k.chkt;
+
+                k.chkt = 1;
+                packet_send('Y', packet->seq, params, params_len);
+                k.chkt = chkt;
+            }
+            else
+            {
+                packet_send('Y', packet->seq, NULL, 0);
+            }
+            continue;
+        }
+
+        slot = &slots[(base + offset) % SLOTS];
+        slot->used = true;
+        slot->type = packet->type;
+        slot->len = packet->len;
+        memcpy(slot->data, packet->data, packet->len);
+
+        if (packet->type == 'D')
+        {
+            if (!k.streaming)
+            {
+                packet_send('Y', packet->seq, NULL, 0);
+            }
+
+            /* Request packets skipped since highest received packet */
+            for (unsigned long i = top > base ? top : base; i < base + offset; i++)
+            {
+                if (!slots[i % SLOTS].used)
+                {
+                    packet_send('N', i & 63, NULL, 0);
+                }
+            }
+        }
+        if (base + offset >= top)
+        {
+            top = base + offset + 1;
+        }
+
+        while (slots[base % SLOTS].used)
+        {
+            int status;
+
+            slots[base % SLOTS].used = false;
+            status = receive_process(fd, &slots[base % SLOTS], base & 63);
+            if (status < 0)
+            {
+                goto out;
+            }
+            base++;
+            nak_sent = false;
+            if (status == 1)
+            {
+                rc = OK;
+                goto out;
+            }
+        }
+    }
+
+out:
+    free(packet);
+    free(slots);
+    return rc;
+}
+
+int kermit_receive(int sio, const char *filename)
+{
+    int fd, rc;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0)
+    {
+        tio_error_print("Could not open file");
+        return ERR;
+    }
+
+    session_reset(sio);
+    progress_start(0);
+    key_hit = 0;
+
+    rc = receive_file(fd);
+    if ((rc < 0) && key_hit)
+    {
+        packet_send_string('E', 0, "Cancelled by user");
+    }
+    summary();
+
+    key_hit = 0xff;
+
+    /* Let the final acknowledgement reach the sender before discarding input */
+    tcdrain(sio);
+    tcflush(sio, TCIFLUSH);
+    close(fd);
+
+    return rc;
+}
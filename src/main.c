@@ -61,6 +61,38 @@ int main(int argc, char *argv[])
     /* Configure tty device */
     tty_configure();
 
+    /* Run device event monitor */
+    if (option.monitor_devices)
+    {
+        /* Keep stdout for events only */
+        option.mute = true;
+        if (option.socket)
+        {
+            socket_configure();
+        }
+        return tty_monitor_devices();
+    }
+
+    /* Run headless file transfer and exit */
+    if (option.transfer != TRANSFER_NONE)
+    {
+        setvbuf(stdout, NULL, _IONBF, 0);
+        if (!isatty(fileno(stdout)))
+        {
+            option.color = -1;
+        }
+        print_init_ansi_formatting();
+
+        /* Create log file for transfer summary */
+        atexit(&log_exit);
+        if (option.log)
+        {
+            log_open(option.log_filename);
+        }
+
+        return tty_transfer();
+    }
+
     /* Disable line buffering in stdout. This is necessary if we
      * want things like local echo to work correctly. */
     setvbuf(stdout, NULL, _IONBF, 0);
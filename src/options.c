@@ -53,12 +53,17 @@ enum opt_t
     OPT_SCRIPT,
     OPT_SCRIPT_FILE,
     OPT_SCRIPT_RUN,
+    OPT_SCRIPT_MEMORY_LIMIT,
+    OPT_SCRIPT_INSTRUCTION_LIMIT,
+    OPT_MONITOR_DEVICES,
     OPT_INPUT_MODE,
     OPT_OUTPUT_MODE,
     OPT_EXCLUDE_DEVICES,
     OPT_EXCLUDE_DRIVERS,
     OPT_EXCLUDE_TIDS,
     OPT_EXEC,
+    OPT_SEND,
+    OPT_RECEIVE,
 };
 
 /* Default options */
@@ -101,9 +106,12 @@ struct option_t option =
     .rs485_delay_rts_after_send = -1,
     .alert = ALERT_NONE,
     .complete_profiles = false,
+    .monitor_devices = false,
     .script = NULL,
     .script_filename = NULL,
     .script_run = SCRIPT_RUN_ALWAYS,
+    .script_memory_limit = 0,
+    .script_instruction_limit = 0,
     .timestamp_timeout = 200,
     .exclude_devices = NULL,
     .exclude_drivers = NULL,
@@ -111,6 +119,9 @@ struct option_t option =
     .hex_n_value = 0,
     .vt100 = false,
     .exec = NULL,
+    .transfer = TRANSFER_NONE,
+    .transfer_protocol = YMODEM,
+    .transfer_filename = NULL,
     .map_i_nl_cr = false,
     .map_i_cr_nl = false,
     .map_ign_cr = false,
@@ -155,6 +166,7 @@ void option_print_help(char *argv[])
     printf("      --timestamp-format <format>        Set timestamp format (default: 24hour)\n");
     printf("      --timestamp-timeout <ms>           Set timestamp timeout (default: 200)\n");
     printf("  -l, --list                             List available serial devices, TIDs, and profiles\n");
+    printf("      --monitor-devices                  Stream serial device events as JSON lines\n");
     printf("  -L, --log                              Enable log to file\n");
     printf("      --log-file <filename>              Set log filename\n");
     printf("      --log-directory <path>             Set log directory path for automatic named logs\n");
@@ -170,7 +182,11 @@ void option_print_help(char *argv[])
     printf("      --script <string>                  Run script from string\n");
     printf("      --script-file <filename>           Run script from file\n");
     printf("      --script-run once|always|never     Run script on connect (default: always)\n");
+    printf("      --script-memory-limit <MB>         Limit script memory usage (default: 0, no limit)\n");
+    printf("      --script-instruction-limit <count> Limit instructions per script run (default: 0, no limit)\n");
     printf("      --exec <command>                   Execute shell command with I/O redirected to device\n");
+    printf("      --send <protocol>:<filename>       Send file and exit\n");
+    printf("      --receive <protocol>:<filename>    Receive file and exit\n");
     printf("      --complete-profiles                Prints profiles (for shell completion)\n");
     printf("  -v, --version                          Display version\n");
     printf("  -h, --help                             Display help\n");
@@ -818,6 +834,53 @@ void option_parse_mappings(const char *map)
     free(buffer);
 }
 
+void option_parse_transfer(const char *arg, transfer_t transfer)
+{
+    const char *filename;
+    size_t length;
+
+    assert(arg != NULL);
+
+    filename = strchr(arg, ':');
+    if ((filename == NULL) || (strlen(filename + 1) == 0))
+    {
+        tio_error_print("Invalid transfer '%s', must be on the form <protocol>:<filename>", arg);
+        exit(EXIT_FAILURE);
+    }
+    length = filename - arg;
+
+    if (strncmp("xmodem-1k", arg, length) == 0 && length == strlen("xmodem-1k"))
+    {
+        option.transfer_protocol = XMODEM_1K;
+    }
+    else if (strncmp("xmodem-crc", arg, length) == 0 && length == strlen("xmodem-crc"))
+    {
+        option.transfer_protocol = XMODEM_CRC;
+    }
+    else if (strncmp("ymodem", arg, length) == 0 && length == strlen("ymodem"))
+    {
+        option.transfer_protocol = YMODEM;
+    }
+    else if (strncmp("kermit", arg, length) == 0 && length == strlen("kermit"))
+    {
+        option.transfer_protocol = KERMIT;
+    }
+    else
+    {
+        tio_error_print("Invalid transfer protocol '%.*s'", (int) length, arg);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((transfer == TRANSFER_RECEIVE) && (option.transfer_protocol != XMODEM_CRC) && (option.transfer_protocol != KERMIT))
+    {
+        tio_error_print("Receive is only supported for xmodem-crc and kermit");
+        exit(EXIT_FAILURE);
+    }
+
+    option.transfer = transfer;
+    option.transfer_filename = (char *) filename + 1;
+}
+
 void options_print()
 {
     tio_printf(" Device: %s", device_name);
@@ -861,6 +924,14 @@ void options_print()
         tio_printf(" Script file: %s", option.script_filename);
         tio_printf(" Script run: %s", script_run_state_to_string(option.script_run));
     }
+    if (option.script_memory_limit > 0)
+    {
+        tio_printf(" Script memory limit: %d MB", option.script_memory_limit);
+    }
+    if (option.script_instruction_limit > 0)
+    {
+        tio_printf(" Script instruction limit: %d", option.script_instruction_limit);
+    }
 }
 
 void options_parse(int argc, char *argv[])
@@ -909,6 +980,7 @@ void options_parse(int argc, char *argv[])
             {"timestamp-format",     required_argument, 0, OPT_TIMESTAMP_FORMAT    },
             {"timestamp-timeout",    required_argument, 0, OPT_TIMESTAMP_TIMEOUT   },
             {"list",                 no_argument,       0, 'l'                     },
+            {"monitor-devices",      no_argument,       0, OPT_MONITOR_DEVICES     },
             {"log",                  no_argument,       0, 'L'                     },
             {"log-file",             required_argument, 0, OPT_LOG_FILE            },
             {"log-directory",        required_argument, 0, OPT_LOG_DIRECTORY       },
@@ -926,7 +998,11 @@ void options_parse(int argc, char *argv[])
             {"script",               required_argument, 0, OPT_SCRIPT              },
             {"script-file",          required_argument, 0, OPT_SCRIPT_FILE         },
             {"script-run",           required_argument, 0, OPT_SCRIPT_RUN          },
+            {"script-memory-limit",  required_argument, 0, OPT_SCRIPT_MEMORY_LIMIT },
+            {"script-instruction-limit", required_argument, 0, OPT_SCRIPT_INSTRUCTION_LIMIT },
             {"exec",                 required_argument, 0, OPT_EXEC                },
+            {"send",                 required_argument, 0, OPT_SEND                },
+            {"receive",              required_argument, 0, OPT_RECEIVE             },
             {"version",              no_argument,       0, 'v'                     },
             {"help",                 no_argument,       0, 'h'                     },
             {"complete-profiles",    no_argument,       0, OPT_COMPLETE_PROFILES   },
@@ -1036,6 +1112,10 @@ void options_parse(int argc, char *argv[])
                 exit(EXIT_SUCCESS);
                 break;
 
+            case OPT_MONITOR_DEVICES:
+                option.monitor_devices = true;
+                break;
+
             case OPT_LOG_FILE:
                 option.log_filename = optarg;
                 break;
@@ -1100,10 +1180,26 @@ void options_parse(int argc, char *argv[])
                 option_parse_script_run(optarg, &option.script_run);
                 break;
 
+            case OPT_SCRIPT_MEMORY_LIMIT:
+                option_string_to_integer(optarg, &option.script_memory_limit, "script memory limit", 0, INT_MAX / 1024);
+                break;
+
+            case OPT_SCRIPT_INSTRUCTION_LIMIT:
+                option_string_to_integer(optarg, &option.script_instruction_limit, "script instruction limit", 0, INT_MAX);
+                break;
+
             case OPT_EXEC:
                 option.exec = optarg;
                 break;
 
+            case OPT_SEND:
+                option_parse_transfer(optarg, TRANSFER_SEND);
+                break;
+
+            case OPT_RECEIVE:
+                option_parse_transfer(optarg, TRANSFER_RECEIVE);
+                break;
+
             case 'v':
                 printf("tio %s\n", VERSION);
                 exit(EXIT_SUCCESS);
@@ -1138,7 +1234,7 @@ void options_parse(int argc, char *argv[])
         option.target = argv[optind++];
     }
 
-    if (option.complete_profiles)
+    if (option.complete_profiles || option.monitor_devices)
     {
         return;
     }
@@ -27,6 +27,7 @@
 #include "timestamp.h"
 #include "alert.h"
 #include "tty.h"
+#include "xymodem.h"
 
 typedef enum
 {
@@ -43,6 +44,13 @@ typedef enum
     OUTPUT_MODE_END,
 } output_mode_t;
 
+typedef enum
+{
+    TRANSFER_NONE,
+    TRANSFER_SEND,
+    TRANSFER_RECEIVE,
+} transfer_t;
+
 /* Options */
 struct option_t
 {
@@ -83,9 +91,12 @@ struct option_t
     int32_t rs485_delay_rts_after_send;
     alert_t alert;
     bool complete_profiles;
+    bool monitor_devices;
     char *script;
     char *script_filename;
     script_run_t script_run;
+    int script_memory_limit;
+    int script_instruction_limit;
     int timestamp_timeout;
     char *exclude_devices;
     char *exclude_drivers;
@@ -93,6 +104,9 @@ struct option_t
     int hex_n_value;
     bool vt100;
     char *exec;
+    transfer_t transfer;
+    modem_mode_t transfer_protocol;
+    char *transfer_filename;
     bool map_i_nl_cr;
     bool map_i_cr_nl;
     bool map_ign_cr;
@@ -133,3 +147,5 @@ void option_parse_timestamp(const char *arg, timestamp_t *timestamp);
 const char* option_timestamp_format_to_string(timestamp_t timestamp);
 
 void option_parse_mappings(const char *map);
+
+void option_parse_transfer(const char *arg, transfer_t transfer);
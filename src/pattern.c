@@ -0,0 +1,611 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Lua pattern matching over data which grows between searches, as done by
+ * tio.expect() on received data.
+ *
+ * The matcher is the one of string.find() in Lua 5.4 lstrlib.c (Copyright
+ * (C) 1994-2023 Lua.org, PUC-Rio, MIT license), extended to note whether an
+ * attempt to match at a start position looked at the end of the data. If it
+ * did not, no data appended later can make a match start there, so later
+ * searches resume at the earliest start position which may still match
+ * instead of rescanning all data.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <lauxlib.h>
+#include "pattern.h"
+
+#define L_ESC '%'
+#define CAP_UNFINISHED (-1)
+#define CAP_POSITION (-2)
+#define MAX_CAPTURES 32
+#define MAX_DEPTH 200 // Max. recursion depth of matcher
+
+#define uchar(c) ((unsigned char) (c))
+
+typedef struct
+{
+    const char *src_init;
+    const char *src_end;
+    const char *p_end;
+    lua_State *L;
+    int depth;
+    int level;
+    bool hit_end;           // Attempt looked at end of data
+    struct
+    {
+        const char *init;
+        ptrdiff_t len;
+    } capture[MAX_CAPTURES];
+} match_state_t;
+
+static const char *match(match_state_t *ms, const char *s, const char *p);
+
+static int check_capture(match_state_t *ms, int l)
+{
+    l -= '1';
+    if ((l < 0) || (l >= ms->level) || (ms->capture[l].len == CAP_UNFINISHED))
+    {
+        return luaL_error(ms->L, "invalid capture index %%%d", l + 1);
+    }
+
+    return l;
+}
+
+static int capture_to_close(match_state_t *ms)
+{
+    for (int level = ms->level - 1; level >= 0; level--)
+    {
+        if (ms->capture[level].len == CAP_UNFINISHED)
+        {
+            return level;
+        }
+    }
+
+    return luaL_error(ms->L, "invalid pattern capture");
+}
+
+static const char *class_end(match_state_t *ms, const char *p)
+{
+    switch (*p++)
+    {
+        case L_ESC:
+            if (p == ms->p_end)
+            {
+                luaL_error(ms->L, "malformed pattern (ends with '%%')");
+            }
+            return p + 1;
+
+        case '[':
+            if (*p == '^')
+            {
+                p++;
+            }
+            do
+            {
+                // Look for a ']'
+                if (p == ms->p_end)
+                {
+                    luaL_error(ms->L, "malformed pattern (missing ']')");
+                }
+                if ((*(p++) == L_ESC) && (p < ms->p_end))
+                {
+                    p++; // Skip escapes (e.g. '%]')
+                }
+            } while (*p != ']');
+            return p + 1;
+
+        default:
+            return p;
+    }
+}
+
+static int match_class(int c, int cl)
+{
+    int res;
+
+    switch (tolower(cl))
+    {
+        case 'a': res = isalpha(c); break;
+        case 'c': res = iscntrl(c); break;
+        case 'd': res = isdigit(c); break;
+        case 'g': res = isgraph(c); break;
+        case 'l': res = islower(c); break;
+        case 'p': res = ispunct(c); break;
+        case 's': res = isspace(c); break;
+        case 'u': res = isupper(c); break;
+        case 'w': res = isalnum(c); break;
+        case 'x': res = isxdigit(c); break;
+        default: return (cl == c);
+    }
+    if (isupper(cl))
+    {
+        res = !res;
+    }
+
+    return res;
+}
+
+static int match_bracket_class(int c, const char *p, const char *ec)
+{
+    int sig = 1;
+
+    if (*(p + 1) == '^')
+    {
+        sig = 0;
+        p++;
+    }
+    while (++p < ec)
+    {
+        if (*p == L_ESC)
+        {
+            p++;
+            if (match_class(c, uchar(*p)))
+            {
+                return sig;
+            }
+        }
+        else if ((*(p + 1) == '-') && (p + 2 < ec))
+        {
+            p += 2;
+            if ((uchar(*(p - 2)) <= c) && (c <= uchar(*p)))
+            {
+                return sig;
+            }
+        }
+        else if (uchar(*p) == c)
+        {
+            return sig;
+        }
+    }
+
+    return !sig;
+}
+
+static int single_match(match_state_t *ms, const char *s, const char *p, const char *ep)
+{
+    if (s >= ms->src_end)
+    {
+        ms->hit_end = true;
+        return 0;
+    }
+
+    switch (*p)
+    {
+        case '.':
+            return 1;
+        case L_ESC:
+            return match_class(uchar(*s), uchar(*(p + 1)));
+        case '[':
+            return match_bracket_class(uchar(*s), p, ep - 1);
+        default:
+            return (uchar(*p) == uchar(*s));
+    }
+}
+
+static const char *match_balance(match_state_t *ms, const char *s, const char *p)
+{
+    int cont = 1;
+
+    if (p >= ms->p_end - 1)
+    {
+        luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
+    }
+    if (s >= ms->src_end)
+    {
+        ms->hit_end = true;
+        return NULL;
+    }
+    if (*s != *p)
+    {
+        return NULL;
+    }
+
+    while (++s < ms->src_end)
+    {
+        if (*s == *(p + 1))
+        {
+            if (--cont == 0)
+            {
+                return s + 1;
+            }
+        }
+        else if (*s == *p)
+        {
+            cont++;
+        }
+    }
+
+    // Out of balance so far
+    ms->hit_end = true;
+    return NULL;
+}
+
+static const char *max_expand(match_state_t *ms, const char *s, const char *p, const char *ep)
+{
+    ptrdiff_t i = 0;
+
+    while (single_match(ms, s + i, p, ep))
+    {
+        i++;
+    }
+    // Try to match rest of pattern with maximum repetitions first
+    while (i >= 0)
+    {
+        const char *res = match(ms, s + i, ep + 1);
+
+        if (res != NULL)
+        {
+            return res;
+        }
+        i--;
+    }
+
+    return NULL;
+}
+
+static const char *min_expand(match_state_t *ms, const char *s, const char *p, const char *ep)
+{
+    while (true)
+    {
+        const char *res = match(ms, s, ep + 1);
+
+        if (res != NULL)
+        {
+            return res;
+        }
+        if (!single_match(ms, s, p, ep))
+        {
+            return NULL;
+        }
+        s++;
+    }
+}
+
+static const char *start_capture(match_state_t *ms, const char *s, const char *p, int what)
+{
+    const char *res;
+
+    if (ms->level >= MAX_CAPTURES)
+    {
+        luaL_error(ms->L, "too many captures");
+    }
+    ms->capture[ms->level].init = s;
+    ms->capture[ms->level].len = what;
+    ms->level++;
+    res = match(ms, s, p);
+    if (res == NULL)
+    {
+        ms->level--;
+    }
+
+    return res;
+}
+
+static const char *end_capture(match_state_t *ms, const char *s, const char *p)
+{
+    int l = capture_to_close(ms);
+    const char *res;
+
+    ms->capture[l].len = s - ms->capture[l].init;
+    res = match(ms, s, p);
+    if (res == NULL)
+    {
+        ms->capture[l].len = CAP_UNFINISHED;
+    }
+
+    return res;
+}
+
+static const char *match_capture(match_state_t *ms, const char *s, int l)
+{
+    size_t len;
+
+    l = check_capture(ms, l);
+    len = ms->capture[l].len;
+    if ((size_t) (ms->src_end - s) < len)
+    {
+        // Could still match once more data arrives
+        ms->hit_end = true;
+        return NULL;
+    }
+    if (memcmp(ms->capture[l].init, s, len) == 0)
+    {
+        return s + len;
+    }
+
+    return NULL;
+}
+
+static const char *match(match_state_t *ms, const char *s, const char *p)
+{
+    if (ms->depth-- == 0)
+    {
+        luaL_error(ms->L, "pattern too complex");
+    }
+
+init:
+    if (p != ms->p_end)
+    {
+        switch (*p)
+        {
+            case '(':
+                if (*(p + 1) == ')')
+                {
+                    s = start_capture(ms, s, p + 2, CAP_POSITION);
+                }
+                else
+                {
+                    s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+                }
+                break;
+
+            case ')':
+                s = end_capture(ms, s, p + 1);
+                break;
+
+            case '$':
+                if ((p + 1) != ms->p_end)
+                {
+                    goto dflt;
+                }
+                s = (s == ms->src_end) ? s : NULL;
+                break;
+
+            case L_ESC:
+                switch (*(p + 1))
+                {
+                    case 'b':
+                        s = match_balance(ms, s, p + 2);
+                        if (s != NULL)
+                        {
+                            p += 4;
+                            goto init;
+                        }
+                        break;
+
+                    case 'f':
+                    {
+                        const char *ep;
+                        char previous, current;
+
+                        p += 2;
+                        if (*p != '[')
+                        {
+                            luaL_error(ms->L, "missing '[' after '%%f' in pattern");
+                        }
+                        ep = class_end(ms, p);
+                        previous = (s == ms->src_init) ? '\0' : *(s - 1);
+                        if (s < ms->src_end)
+                        {
+                            current = *s;
+                        }
+                        else
+                        {
+                            current = '\0';
+                            ms->hit_end = true;
+                        }
+                        if (!match_bracket_class(uchar(previous), p, ep - 1) &&
+                            match_bracket_class(uchar(current), p, ep - 1))
+                        {
+                            p = ep;
+                            goto init;
+                        }
+                        s = NULL;
+                        break;
+                    }
+
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8': case '9':
+                        s = match_capture(ms, s, uchar(*(p + 1)));
+                        if (s != NULL)
+                        {
+                            p += 2;
+                            goto init;
+                        }
+                        break;
+
+                    default:
+                        goto dflt;
+                }
+                break;
+
+            default:
+            dflt:
+            {
+                const char *ep = class_end(ms, p);
+
+                if (!single_match(ms, s, p, ep))
+                {
+                    if ((*ep == '*') || (*ep == '?') || (*ep == '-'))
+                    {
+                        // Accept empty
+                        p = ep + 1;
+                        goto init;
+                    }
+                    s = NULL;
+                }
+                else
+                {
+                    switch (*ep)
+                    {
+                        case '?':
+                        {
+                            const char *res = match(ms, s + 1, ep + 1);
+
+                            if (res != NULL)
+                            {
+                                s = res;
+                            }
+                            else
+                            {
+                                p = ep + 1;
+                                goto init;
+                            }
+                            break;
+                        }
+                        case '+':
+                            s = max_expand(ms, s + 1, p, ep);
+                            break;
+                        case '*':
+                            s = max_expand(ms, s, p, ep);
+                            break;
+                        case '-':
+                            s = min_expand(ms, s, p, ep);
+                            break;
+                        default:
+                            s++;
+                            p = ep;
+                            goto init;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    ms->depth++;
+    return s;
+}
+
+/* Push captures of match from s to e like string.match() does */
+static int push_captures(match_state_t *ms, const char *s, const char *e)
+{
+    int count = (ms->level == 0) ? 1 : ms->level;
+
+    luaL_checkstack(ms->L, count, "too many captures");
+    if (ms->level == 0)
+    {
+        lua_pushlstring(ms->L, s, e - s);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        ptrdiff_t len = ms->capture[i].len;
+
+        if (len == CAP_UNFINISHED)
+        {
+            luaL_error(ms->L, "unfinished capture");
+        }
+        if (len == CAP_POSITION)
+        {
+            lua_pushinteger(ms->L, (ms->capture[i].init - ms->src_init) + 1);
+        }
+        else
+        {
+            lua_pushlstring(ms->L, ms->capture[i].init, len);
+        }
+    }
+
+    return count;
+}
+
+/* Find leftmost match of pattern in first len bytes of data, trying start
+ * positions from *start on. On match, *start is set to the start of the match
+ * and, unless results is NULL, captures are pushed and their number stored in
+ * results. Otherwise *start is set to the earliest position a match may start
+ * at once more data is appended. Errors in the pattern are raised.
+ */
+bool pattern_find(lua_State *L, const char *pattern, size_t pattern_len,
+                  const char *data, size_t len, size_t *start, int *results)
+{
+    match_state_t ms;
+    const char *p = pattern;
+    bool anchor = (pattern_len > 0) && (*p == '^');
+    size_t viable = len;
+    bool viable_found = false;
+
+    if (anchor)
+    {
+        p++;
+        if (*start > 0)
+        {
+            return false;
+        }
+    }
+
+    ms.L = L;
+    ms.src_init = data;
+    ms.src_end = data + len;
+    ms.p_end = pattern + pattern_len;
+
+    for (const char *s = data + *start; s <= ms.src_end; s++)
+    {
+        const char *e;
+
+        ms.level = 0;
+        ms.depth = MAX_DEPTH;
+        ms.hit_end = false;
+
+        e = match(&ms, s, p);
+        if (e != NULL)
+        {
+            *start = s - data;
+            if (results != NULL)
+            {
+                *results = push_captures(&ms, s, e);
+            }
+            return true;
+        }
+        if (ms.hit_end && !viable_found)
+        {
+            viable = s - data;
+            viable_found = true;
+        }
+        if (anchor)
+        {
+            break;
+        }
+    }
+
+    *start = viable;
+    return false;
+}
+
+/* Returns true if pattern may match some data but not the same data with more
+ * appended, i.e. if it is anchored at the end or has a frontier. Patterns
+ * that are not can be searched for the shortest matching prefix of data by
+ * bisection.
+ */
+bool pattern_end_sensitive(const char *pattern, size_t pattern_len)
+{
+    for (size_t i = 0; i < pattern_len; i++)
+    {
+        if (pattern[i] == L_ESC)
+        {
+            if ((i + 1 < pattern_len) && (pattern[i + 1] == 'f'))
+            {
+                return true;
+            }
+            i++;
+        }
+        else if ((pattern[i] == '$') && (i == pattern_len - 1))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
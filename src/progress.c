@@ -0,0 +1,183 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2024  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * File transfer progress and summary, shared by the X/YMODEM and Kermit
+ * engines.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include "progress.h"
+#include "options.h"
+#include "print.h"
+#include "misc.h"
+#include "log.h"
+
+/* Minimum interval between progress redraws [s] */
+#define PROGRESS_INTERVAL 0.2
+
+static struct
+{
+    size_t total;           /* Expected payload size [bytes], 0 if unknown */
+    size_t bytes;           /* Transferred payload [bytes] */
+    double start;           /* Transfer start time [s] */
+    double redraw;          /* Last progress redraw time [s] */
+    long cpu;               /* Process CPU time at transfer start [us] */
+    long switches;          /* Context switches at transfer start */
+} progress;
+
+/* Time it takes to shift len bytes onto the line at configured settings */
+long line_time_us(size_t len)
+{
+    int bits = 1 + option.databits + option.stopbits + (option.parity != PARITY_NONE);
+
+    if (option.baudrate <= 0)
+    {
+        return 0;
+    }
+
+    return (long) ((double) len * bits * 1000000 / option.baudrate);
+}
+
+/* Theoretical payload rate [bytes/s] of the line at configured settings */
+static double line_rate(void)
+{
+    long t = line_time_us(1000000);
+
+    return t > 0 ? 1e12 / t : 0;
+}
+
+/* Process CPU time [us] and number of context switches so far */
+static void cpu_usage(long *cpu, long *switches)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    *cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000L +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+    *switches = ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void progress_format(GString *line, unsigned long retries, bool final)
+{
+    double elapsed = get_current_time() - progress.start;
+    double rate = elapsed > 0 ? progress.bytes / elapsed : 0;
+    double efficiency = line_rate() > 0 ? 100 * rate / line_rate() : 0;
+
+    if (final)
+    {
+        g_string_append_printf(line, "Transferred %zu bytes in %.1f s", progress.bytes, elapsed);
+    }
+    else if (progress.total)
+    {
+        g_string_append_printf(line, "%zu/%zu bytes (%d%%)", progress.bytes, progress.total,
+                               (int) (100.0 * progress.bytes / progress.total));
+    }
+    else
+    {
+        g_string_append_printf(line, "%zu bytes", progress.bytes);
+    }
+
+    g_string_append_printf(line, ", %.0f bytes/s, efficiency %.0f%%, retries %lu",
+                           rate, efficiency, retries);
+
+    if (!final && progress.total && rate > 0 && progress.bytes < progress.total)
+    {
+        long eta = (progress.total - progress.bytes) / rate;
+        g_string_append_printf(line, ", ETA %02ld:%02ld", eta / 60, eta % 60);
+    }
+}
+
+void progress_start(size_t total)
+{
+    progress.total = total;
+    progress.bytes = 0;
+    progress.start = get_current_time();
+    progress.redraw = 0;
+    cpu_usage(&progress.cpu, &progress.switches);
+}
+
+/* Set expected payload size once it is known, e.g. from a file header */
+void progress_set_total(size_t total)
+{
+    progress.total = total;
+}
+
+/* Account for transferred payload and redraw progress line if due */
+void progress_update(size_t bytes, unsigned long retries)
+{
+    double now = get_current_time();
+    GString *line;
+
+    progress.bytes += bytes;
+
+    if ((now - progress.redraw) < PROGRESS_INTERVAL)
+    {
+        return;
+    }
+    progress.redraw = now;
+
+    /* Only redraw progress on a terminal */
+    if (!isatty(STDOUT_FILENO))
+    {
+        return;
+    }
+
+    line = g_string_new(NULL);
+    progress_format(line, retries, false);
+    clear_line();
+    ansi_printf_raw("[%s] %s", timestamp_current_time(), line->str);
+    print_tainted = true;
+    g_string_free(line, TRUE);
+}
+
+/* Print and log final transfer summary with protocol specific details */
+void progress_finish(unsigned long retries, const char *format, ...)
+{
+    GString *line = g_string_new(NULL);
+    long cpu, switches;
+    va_list args;
+
+    progress_format(line, retries, true);
+
+    va_start(args, format);
+    g_string_append_vprintf(line, format, args);
+    va_end(args);
+
+    cpu_usage(&cpu, &switches);
+    g_string_append_printf(line, ", CPU %.2f s, context switches %ld",
+                           (cpu - progress.cpu) / 1e6, switches - progress.switches);
+
+    clear_line();
+    print_tainted = false;
+    tio_printf("%s", line->str);
+
+    if (option.log)
+    {
+        log_printf("\n[%s] %s\n", timestamp_current_time(), line->str);
+    }
+
+    g_string_free(line, TRUE);
+}
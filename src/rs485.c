@@ -34,6 +34,7 @@
 static struct serial_rs485 rs485_config_saved;
 static struct serial_rs485 rs485_config;
 static bool rs485_config_written = false;
+static bool rs485_config_prepared = false;
 
 void rs485_parse_config(const char *arg)
 {
@@ -132,29 +133,35 @@ void rs485_print_config(void)
 
 int rs485_mode_enable(int fd)
 {
-    /* Save existing RS-485 configuration */
-    ioctl (fd, TIOCGRS485, &rs485_config_saved);
+    /* Configuration is prepared on first connect and reused on reconnect */
+    if (!rs485_config_prepared)
+    {
+        /* Save existing RS-485 configuration */
+        ioctl (fd, TIOCGRS485, &rs485_config_saved);
 
-    /* Prepare new RS-485 configuration */
-    rs485_config.flags = SER_RS485_ENABLED;
-    rs485_config.flags |= option.rs485_config_flags;
+        /* Prepare new RS-485 configuration */
+        rs485_config.flags = SER_RS485_ENABLED;
+        rs485_config.flags |= option.rs485_config_flags;
 
-    if (option.rs485_delay_rts_before_send > 0)
-    {
-        rs485_config.delay_rts_before_send = option.rs485_delay_rts_before_send;
-    }
-    else
-    {
-        rs485_config.delay_rts_before_send = rs485_config_saved.delay_rts_before_send;
-    }
+        if (option.rs485_delay_rts_before_send > 0)
+        {
+            rs485_config.delay_rts_before_send = option.rs485_delay_rts_before_send;
+        }
+        else
+        {
+            rs485_config.delay_rts_before_send = rs485_config_saved.delay_rts_before_send;
+        }
 
-    if (option.rs485_delay_rts_after_send > 0)
-    {
-        rs485_config.delay_rts_after_send = option.rs485_delay_rts_after_send;
-    }
-    else
-    {
-        rs485_config.delay_rts_after_send = rs485_config_saved.delay_rts_after_send;
+        if (option.rs485_delay_rts_after_send > 0)
+        {
+            rs485_config.delay_rts_after_send = option.rs485_delay_rts_after_send;
+        }
+        else
+        {
+            rs485_config.delay_rts_after_send = rs485_config_saved.delay_rts_after_send;
+        }
+
+        rs485_config_prepared = true;
     }
 
     /* Write new RS-485 configuration */
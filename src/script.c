@@ -19,6 +19,7 @@
  * 02110-1301, USA.
  */
 
+#define _GNU_SOURCE // For memmem()
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,23 +28,278 @@
 #include <time.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <ctype.h>
 #include "misc.h"
 #include "print.h"
 #include "options.h"
 #include "tty.h"
 #include "xymodem.h"
+#include "kermit.h"
+#include "frame.h"
 #include "log.h"
 #include "script.h"
 #include "fs.h"
 #include "timestamp.h"
+#include "pattern.h"
 #include "termios.h"
 
 #define MAX_BUFFER_SIZE 2000 // Maximum size of circular buffer
 #define READ_LINE_SIZE 4096 // read_line buffer length
+#define CHUNK_CACHE "tio.chunks" // Registry key of compiled chunk cache
+#define RX_BUFFER_SIZE 65536 // Device receive buffer size
+#define EXPECT_WINDOW 65536 // Max. amount of text kept for matching by expect
+#define HOOK_BUDGET 100 // Max. time a hook may run [ms]
+#define TX_QUEUE_SIZE 4096 // Script writes are coalesced up to this size
+#define TX_TIMEOUT 5000 // Max. time to wait for device to accept more data [ms]
+#define HOOK_COUNT 1000 // Instructions between budget checks
+#define POOL_GRANULARITY 16 // Size step of small object pools
+#define POOL_MAX 256 // Largest object size served from pools
+#define POOL_CHUNK_SIZE 65536 // Pool memory is carved from chunks of this size
 
 static int device_fd;
+static lua_State *script_state = NULL;
+
+/* Device data read ahead by expect but not yet consumed */
+static struct
+{
+    char data[RX_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+} rx;
+
+/* Data written by script but not yet sent to device */
+static GString *tx_queue = NULL;
+
+/* Memory used by Lua state. Small objects are served from per size class
+ * free lists carved from large chunks, which are kept for reuse. */
+static struct
+{
+    size_t used;
+    size_t peak;
+    size_t limit;           // 0 means no limit
+    bool limit_reached;
+    void *free_list[POOL_MAX / POOL_GRANULARITY];
+    char *chunk;
+    size_t chunk_left;
+} memory;
+
+static unsigned long instructions;
+static int instruction_limit;
+static double hook_deadline;
+
+static int pool_class(size_t size)
+{
+    return (size - 1) / POOL_GRANULARITY;
+}
+
+static void *pool_alloc(size_t size)
+{
+    int class = pool_class(size);
+    size_t block_size = (class + 1) * POOL_GRANULARITY;
+    void *block = memory.free_list[class];
+
+    if (block != NULL)
+    {
+        memory.free_list[class] = *(void **) block;
+        return block;
+    }
+
+    if (memory.chunk_left < block_size)
+    {
+        // Rest of current chunk is abandoned
+        memory.chunk = malloc(POOL_CHUNK_SIZE);
+        if (memory.chunk == NULL)
+        {
+            memory.chunk_left = 0;
+            return NULL;
+        }
+        memory.chunk_left = POOL_CHUNK_SIZE;
+    }
+
+    block = memory.chunk;
+    memory.chunk += block_size;
+    memory.chunk_left -= block_size;
+
+    return block;
+}
+
+static void pool_free(void *block, size_t size)
+{
+    int class = pool_class(size);
+
+    *(void **) block = memory.free_list[class];
+    memory.free_list[class] = block;
+}
+
+/* Turn pool block of the size class of size into a block of the smaller size
+ * class of new_size, returning the rest of it to the pool */
+static void pool_split(void *block, size_t size, size_t new_size)
+{
+    size_t keep = (pool_class(new_size) + 1) * POOL_GRANULARITY;
+    size_t rest = (pool_class(size) + 1) * POOL_GRANULARITY - keep;
+
+    if (rest > 0)
+    {
+        pool_free((char *) block + keep, rest);
+    }
+}
+
+static void block_free(void *block, size_t size)
+{
+    if (size <= POOL_MAX)
+    {
+        pool_free(block, size);
+    }
+    else
+    {
+        free(block);
+    }
+}
+
+static void *script_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    void *block;
+
+    UNUSED(ud);
+
+    if (ptr == NULL)
+    {
+        osize = 0; // Lua passes object type instead
+    }
+
+    if (nsize == 0)
+    {
+        if (ptr != NULL)
+        {
+            block_free(ptr, osize);
+        }
+        memory.used -= osize;
+        return NULL;
+    }
+
+    if ((nsize > osize) && (memory.limit > 0) && (memory.used - osize + nsize > memory.limit))
+    {
+        memory.limit_reached = true;
+        return NULL;
+    }
+
+    if ((osize > POOL_MAX) && (nsize > POOL_MAX))
+    {
+        block = realloc(ptr, nsize);
+    }
+    else if ((ptr != NULL) && (osize <= POOL_MAX) && (nsize <= POOL_MAX) &&
+             (pool_class(osize) == pool_class(nsize)))
+    {
+        block = ptr;
+    }
+    else
+    {
+        block = nsize <= POOL_MAX ? pool_alloc(nsize) : malloc(nsize);
+        if ((block != NULL) && (ptr != NULL))
+        {
+            memcpy(block, ptr, osize < nsize ? osize : nsize);
+            block_free(ptr, osize);
+        }
+    }
+
+    if (block == NULL)
+    {
+        if (nsize <= osize)
+        {
+            // Shrinking must not fail, so keep data in old block. It must be
+            // of the size class it is freed as later. A large block shrunk
+            // to pool size is big enough for that and stays in the pool.
+            block = ptr;
+            if (osize <= POOL_MAX)
+            {
+                pool_split(ptr, osize, nsize);
+            }
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+
+    memory.used = memory.used - osize + nsize;
+    if (memory.used > memory.peak)
+    {
+        memory.peak = memory.used;
+    }
+
+    return block;
+}
+
+/* Called every HOOK_COUNT instructions to enforce instruction and time budgets.
+ * LuaJIT does not call count hooks from compiled traces, so the budgets are
+ * not enforced in JIT compiled code.
+ */
+static void script_count_hook(lua_State *L, lua_Debug *ar)
+{
+    UNUSED(ar);
+
+    instructions += HOOK_COUNT;
+    if ((instruction_limit > 0) && (instructions > (unsigned long) instruction_limit))
+    {
+        luaL_error(L, "exceeded instruction limit of %d", instruction_limit);
+    }
+
+    if ((hook_deadline != 0) && (get_current_time() > hook_deadline))
+    {
+        luaL_error(L, "exceeded time budget of %d ms", HOOK_BUDGET);
+    }
+}
+
+/* Print usage of script memory or instructions if a limit was reached */
+static void script_limits_print(void)
+{
+    if (memory.limit_reached)
+    {
+        tio_printf(" Script memory: %zu KB used, %zu KB peak, %zu KB limit",
+                   memory.used / 1024, memory.peak / 1024, memory.limit / 1024);
+        memory.limit_reached = false;
+    }
+    if ((instruction_limit > 0) && (instructions > (unsigned long) instruction_limit))
+    {
+        tio_printf(" Script instructions: %lu executed", instructions);
+    }
+}
+
+static void script_error_print(lua_State *L)
+{
+    tio_warning_printf("lua: %s", lua_tostring(L, -1));
+    script_limits_print();
+}
+
+/* Lua errors outside protected calls, e.g. running out of memory while the
+ * state is created, would abort(). Exit through the normal exit path instead.
+ */
+static int script_panic(lua_State *L)
+{
+    tio_error_print("Lua panic (%s)", lua_tostring(L, -1));
+    script_limits_print();
+    exit(EXIT_FAILURE);
+
+    return 0;
+}
+
+/* Call function with argument as light userdata in protected mode. Returns 0
+ * on success or Lua error code with error message pushed.
+ */
+static int script_pcall(lua_State *L, lua_CFunction function, void *arg)
+{
+#if LUA_VERSION_NUM >= 502
+    // Neither pushing a light C function nor a light userdata allocates
+    lua_pushcfunction(L, function);
+    lua_pushlightuserdata(L, arg);
+    return lua_pcall(L, 1, 0, 0);
+#else
+    return lua_cpcall(L, function, arg);
+#endif
+}
 
 static char script_init[] =
 "tio.set = function(arg)\n"
@@ -55,20 +311,40 @@ static char script_init[] =
 "    local ri = arg.RI or -1\n"
 "    tio.line_set(dtr, rts, cts, dsr, cd, ri)\n"
 "end\n"
-"tio.expect = function(pattern, timeout)\n"
-"    local str = ''\n"
-"    while true do\n"
-"        local c = tio.read(1, timeout)\n"
-"        if c then\n"
-"            str = str .. c\n"
-"            if string.match(str, pattern) then\n"
-"                return string.match(str, pattern)\n"
-"            end\n"
-"        else\n"
-"            return nil, str\n"
+"local unpack = table.unpack or unpack\n"
+"local pack = table.pack or function(...) return {n = select('#', ...), ...} end\n"
+"local function tio_retry(f)\n"
+"    return function(...)\n"
+"        local r = pack(f(...))\n"
+"        while r[1] == tio._retry do\n"
+"            coroutine.yield()\n"
+"            r = pack(f(...))\n"
+"        end\n"
+"        return unpack(r, 1, r.n)\n"
+"    end\n"
+"end\n"
+"for _, name in ipairs({'read', 'readline', 'expect', 'expect_any', 'read_frame'}) do\n"
+"    tio[name] = tio_retry(tio[name])\n"
+"end\n"
+"tio.after = function(ms, f)\n"
+"    tio.spawn(function() tio.msleep(ms) f() end)\n"
+"end\n"
+"tio.every = function(ms, f)\n"
+"    tio.spawn(function() repeat tio.msleep(ms) until f() == false end)\n"
+"end\n"
+#ifdef HAVE_LUAJIT
+"local ffi = require('ffi')\n"
+"for _, name in ipairs({'on_rx', 'on_tx'}) do\n"
+"    local set = tio[name]\n"
+"    tio[name] = function(f, view)\n"
+"        if f and view then\n"
+"            local g = f\n"
+"            f = function(p, n) return g(ffi.cast('const uint8_t *', p), n) end\n"
 "        end\n"
+"        return set(f, view)\n"
 "    end\n"
 "end\n"
+#endif
 "tio.alwaysecho = true\n"
 "setmetatable(tio, tio)\n";
 
@@ -123,6 +399,215 @@ static void maybe_echo(lua_State *L)
     }
 }
 
+static void echo(lua_State *L, const char *data, size_t len)
+{
+    if (len > 0)
+    {
+        lua_pushlstring(L, data, len);
+        maybe_echo(L);
+        lua_pop(L, 1);
+    }
+}
+
+/* Write queued data to device, waiting for device to accept it. If drain is
+ * set also wait until data has been transmitted. Returns 0 on success or -1
+ * with errno set on error, in which case queued data is discarded.
+ */
+static int tx_flush(bool drain)
+{
+    size_t written = 0;
+    int status = 0;
+
+    while ((tx_queue != NULL) && (written < tx_queue->len))
+    {
+        ssize_t ret = write(device_fd, tx_queue->str + written, tx_queue->len - written);
+
+        if (ret >= 0)
+        {
+            written += ret;
+            continue;
+        }
+
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            struct pollfd fds = { .fd = device_fd, .events = POLLOUT };
+
+            ret = poll(&fds, 1, TX_TIMEOUT);
+            if (ret == 0)
+            {
+                errno = ETIMEDOUT;
+                status = -1;
+                break;
+            }
+        }
+
+        if ((ret < 0) && (errno != EINTR))
+        {
+            status = -1;
+            break;
+        }
+    }
+
+    if (tx_queue != NULL)
+    {
+        g_string_truncate(tx_queue, 0);
+    }
+
+    if (drain && (status == 0))
+    {
+        tcdrain(device_fd);
+    }
+
+    return status;
+}
+
+static size_t rx_available(void)
+{
+    return rx.end - rx.start;
+}
+
+/* Refill receive buffer if empty, waiting at most timeout ms (-1 waits
+ * forever). Returns number of buffered bytes, 0 on timeout or -1 on error.
+ */
+static ssize_t rx_fill(int timeout)
+{
+    ssize_t ret;
+
+    // Send pending writes before waiting for response
+    if (tx_flush(false) < 0)
+    {
+        return -1;
+    }
+
+    if (rx_available() > 0)
+    {
+        return rx_available();
+    }
+
+    ret = read_poll(device_fd, rx.data, sizeof(rx.data), timeout);
+    if (ret <= 0)
+    {
+        return ret;
+    }
+    rx.start = 0;
+    rx.end = ret;
+
+    return ret;
+}
+
+/* Deadline for wait of timeout ms, 0 meaning wait forever */
+static double rx_deadline(int timeout)
+{
+    return timeout > 0 ? get_current_time() + timeout / 1000.0 : 0;
+}
+
+/* Milliseconds left until deadline, -1 if none */
+static int rx_remaining(double deadline)
+{
+    int remaining;
+
+    if (deadline == 0)
+    {
+        return -1; // Wait forever
+    }
+
+    remaining = (deadline - get_current_time()) * 1000;
+
+    return remaining < 0 ? 0 : remaining;
+}
+
+/* Move up to len buffered bytes to data */
+static size_t rx_take(char *data, size_t len)
+{
+    size_t n = rx_available() < len ? rx_available() : len;
+
+    memcpy(data, rx.data + rx.start, n);
+    rx.start += n;
+
+    return n;
+}
+
+/* Lua task running as coroutine scheduled by main loop */
+typedef struct
+{
+    lua_State *thread;
+    int ref;                // Registry reference keeping thread alive
+    double wake;            // Time to resume task, 0 if none
+    bool wait_rx;           // Resume task when data is received
+    bool rx_new;            // Data received since task last ran
+    GString *rx;            // Data received during operations, not consumed
+    bool pending;           // Blocking operation in progress
+    double deadline;        // Deadline of blocking operation
+    size_t scanned;         // Amount of rx already matched by expect
+    size_t lag;             // Search state of expect, see expect_pattern_t
+    void *any;              // Matcher of expect_any in progress, see
+    int any_ref;            // task_expect_any(), and its registry reference
+} task_t;
+
+static GList *tasks = NULL;
+static task_t *task_current = NULL;
+static char task_retry_marker;
+
+/* Return task if L is running as task, otherwise NULL */
+static task_t *task_get(lua_State *L)
+{
+    return ((task_current != NULL) && (task_current->thread == L)) ? task_current : NULL;
+}
+
+/* Like task_get() for functions which block unless called from a task. A hook
+ * may not block as it would stall the main loop and consume device data meant
+ * for the terminal, so this raises an error in hooks.
+ */
+static task_t *task_get_blocking(lua_State *L, const char *name)
+{
+    task_t *task = task_get(L);
+
+    if ((task == NULL) && (hook_deadline != 0))
+    {
+        luaL_error(L, "tio.%s can not block in a hook, use it in a task (tio.spawn)", name);
+    }
+
+    return task;
+}
+
+static void task_op_begin(task_t *task, int timeout)
+{
+    if (!task->pending)
+    {
+        task->pending = true;
+        task->deadline = rx_deadline(timeout);
+        task->scanned = 0;
+    }
+}
+
+static bool task_op_timed_out(task_t *task)
+{
+    if ((task->deadline != 0) && (get_current_time() >= task->deadline))
+    {
+        task->pending = false;
+        return true;
+    }
+
+    return false;
+}
+
+static int task_op_done(task_t *task, int results)
+{
+    task->pending = false;
+
+    return results;
+}
+
+/* Make task wait for data and retry operation, see tio_retry in script_init */
+static int task_op_retry(lua_State *L, task_t *task)
+{
+    task->wait_rx = true;
+    task->wake = task->deadline;
+    lua_pushlightuserdata(L, &task_retry_marker);
+
+    return 1;
+}
+
 // lua: tio.sleep(seconds)
 static int api_sleep(lua_State *L)
 {
@@ -133,6 +618,20 @@ static int api_sleep(lua_State *L)
         return 0;
     }
 
+    task_t *task = task_get_blocking(L, "sleep");
+
+    if (tx_flush(false) < 0)
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
+
+    if (task != NULL)
+    {
+        // Let other tasks run meanwhile
+        task->wake = get_current_time() + seconds;
+        return lua_yield(L, 0);
+    }
+
     tio_printf("Sleeping %ld seconds", seconds);
 
     sleep(seconds);
@@ -151,6 +650,20 @@ static int api_msleep(lua_State *L)
         return 0;
     }
 
+    task_t *task = task_get_blocking(L, "msleep");
+
+    if (tx_flush(false) < 0)
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
+
+    if (task != NULL)
+    {
+        // Let other tasks run meanwhile
+        task->wake = get_current_time() + mseconds / 1000.0;
+        return lua_yield(L, 0);
+    }
+
     tio_printf("Sleeping %ld ms", mseconds);
     usleep(useconds);
 
@@ -206,6 +719,12 @@ static int line_set(lua_State *L)
         line_config[5].reserved = true;
     }
 
+    // Change lines after written data has been transmitted
+    if (tx_flush(true) < 0)
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
+
     tty_line_set(device_fd, line_config);
 
     return 0;
@@ -223,6 +742,11 @@ static int api_send(lua_State *L)
         return 0;
     }
 
+    if (tx_flush(false) < 0)
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
+
     switch (protocol)
     {
         case XMODEM_1K:
@@ -242,6 +766,12 @@ static int api_send(lua_State *L)
             ret = xymodem_send(device_fd, file, YMODEM);
             tio_printf("%s", ret < 0 ? "Aborted" : "Done");
             break;
+
+        case KERMIT:
+            tio_printf("Sending file '%s' using Kermit", file);
+            ret = kermit_send(device_fd, file);
+            tio_printf("%s", ret < 0 ? "Aborted" : "Done");
+            break;
     }
 
     return 0;
@@ -252,108 +782,1785 @@ static int api_write(lua_State *L)
 {
     size_t len = 0;
     const char *string = luaL_checklstring(L, 1, &len);
-    ssize_t ret;
-    int attempts = 100;
-
-    do {
-        ret = write(device_fd, string, len);
-        if (ret < 0)
-            return luaL_error(L, "%s", strerror(errno));
 
-        len -= ret;
-        string += ret;
-    } while (len > 0 && --attempts);
-
-    if (len > 0)
-        return luaL_error(L, "partial write");
+    if (tx_queue == NULL)
+    {
+        tx_queue = g_string_sized_new(TX_QUEUE_SIZE);
+    }
 
-    fsync(device_fd);  // flush these characters now
-    tcdrain(device_fd); //ensure we flushed characters to our device
+    // Coalesce small writes, sent when queue fills or script waits
+    g_string_append_len(tx_queue, string, len);
+    if ((tx_queue->len >= TX_QUEUE_SIZE) && (tx_flush(false) < 0))
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
 
     lua_getglobal(L, "tio");
 
     return 1;
 }
 
-// lua: tio.read(size, timeout)
+// lua: tio.flush()
+static int api_flush(lua_State *L)
+{
+    if (tx_flush(true) < 0)
+    {
+        return luaL_error(L, "%s", strerror(errno));
+    }
+
+    lua_getglobal(L, "tio");
+
+    return 1;
+}
+
+// lua: tio.read(size, timeout)
 static int api_read(lua_State *L)
 {
-    int size = luaL_checkinteger(L, 1);
-    int timeout = lua_tointeger(L, 2);
+    int size = luaL_checkinteger(L, 1);
+    int timeout = lua_tointeger(L, 2);
+    task_t *task = task_get_blocking(L, "read");
+
+    if (task != NULL)
+    {
+        // Serve from data received by main loop
+        task_op_begin(task, timeout);
+        if (task->rx->len > 0)
+        {
+            size_t n = task->rx->len < (size_t) size ? task->rx->len : (size_t) size;
+
+            lua_pushlstring(L, task->rx->str, n);
+            g_string_erase(task->rx, 0, n);
+            return task_op_done(task, 1);
+        }
+        if (task_op_timed_out(task))
+        {
+            lua_pushnil(L);
+            return 1;
+        }
+        return task_op_retry(L, task);
+    }
+
+    if (timeout == 0)
+    {
+        timeout = -1; // Wait forever
+    }
+
+    luaL_Buffer buffer;
+    luaL_buffinit(L, &buffer);
+
+#if LUA_VERSION_NUM >= 502
+    char *p = luaL_prepbuffsize(&buffer, size);
+#else
+    if (size > LUAL_BUFFERSIZE)
+        return luaL_error(L, "buffer overflow, max size is: %d", LUAL_BUFFERSIZE);
+    char *p = luaL_prepbuffer(&buffer);
+#endif
+
+    ssize_t ret = rx_fill(timeout);
+    if (ret < 0)
+        return luaL_error(L, "%s", strerror(errno));
+
+    ret = rx_take(p, size);
+
+    luaL_addsize(&buffer, ret);
+    luaL_pushresult(&buffer);
+
+    if (ret == 0)
+    {
+        // On timeout return nil instead of an empty string
+        lua_pop(L, 1);
+        lua_pushnil(L);
+    }
+    else
+    {
+        maybe_echo(L);
+    }
+
+    return 1;
+}
+
+// lua: string = tio.readline(timeout)
+static int api_readline(lua_State *L) {
+    int timeout = lua_tointeger(L, 1); //ms
+    double deadline = rx_deadline(timeout);
+    task_t *task = task_get_blocking(L, "readline");
+    luaL_Buffer b;
+
+    if (task != NULL)
+    {
+        // Serve from data received by main loop
+        char *newline;
+
+        task_op_begin(task, timeout);
+        newline = memchr(task->rx->str, '\n', task->rx->len);
+        if (newline != NULL)
+        {
+            size_t n = newline - task->rx->str;
+
+            lua_pushlstring(L, task->rx->str, n);
+            g_string_erase(task->rx, 0, n + 1);
+            return task_op_done(task, 1);
+        }
+        if (task_op_timed_out(task))
+        {
+            lua_pushnil(L);
+            lua_pushlstring(L, task->rx->str, task->rx->len);
+            g_string_truncate(task->rx, 0);
+            return 2;
+        }
+        return task_op_retry(L, task);
+    }
+
+    luaL_buffinit(L, &b);
+    while (true) {
+        ssize_t ret = rx_fill(rx_remaining(deadline));
+        char *newline;
+
+        if (ret < 0)
+            return luaL_error(L, "%s", strerror(errno));
+
+        if (ret == 0)
+        {
+            luaL_pushresult(&b);
+            maybe_echo(L);
+            lua_pushnil(L);
+            lua_insert(L, -2);
+            return 2;
+        }
+
+        newline = memchr(rx.data + rx.start, '\n', rx_available());
+        if (newline != NULL)
+        {
+            luaL_addlstring(&b, rx.data + rx.start, newline - (rx.data + rx.start));
+            rx.start = newline - rx.data + 1;
+            luaL_pushresult(&b);
+            maybe_echo(L);
+            return 1;
+        }
+
+        luaL_addlstring(&b, rx.data + rx.start, rx_available());
+        rx.start = rx.end;
+    }
+}
+
+/* Incremental search of a Lua pattern in data received while expecting it */
+typedef struct
+{
+    const char *pattern;
+    size_t lag;             // How far before end of data searched so far a
+                            // match may still start, SIZE_MAX if anywhere
+} expect_pattern_t;
+
+#define EXPECT_PATTERN(p) ((expect_pattern_t) { (p), SIZE_MAX })
+
+/* Binary search shortest prefix of data, at least lo long, matched by a
+ * pattern which is not end sensitive and known to match len bytes of data
+ * from start on. As such a pattern matches a prefix only if it also matches
+ * any longer prefix, this is where it would first have matched when matching
+ * after each received byte.
+ */
+static size_t expect_shortest_prefix(lua_State *L, const char *pattern, size_t pattern_len,
+                                     const char *data, size_t start, size_t lo, size_t len)
+{
+    size_t hi = len;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t from = start;
+
+        if (pattern_find(L, pattern, pattern_len, data, mid, &from, NULL))
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    return hi;
+}
+
+/* Find shortest prefix of data ending beyond scanned that matches pattern,
+ * only trying match start positions not ruled out by previous searches of
+ * the same data. Pushes match results and returns end of matching prefix or
+ * 0 if no match. Errors in the pattern are raised.
+ */
+static ssize_t expect_match(lua_State *L, expect_pattern_t *ep, const char *data,
+                            size_t scanned, size_t len, int *results)
+{
+    const char *pattern = ep->pattern;
+    size_t pattern_len = strlen(pattern);
+    size_t start = scanned > ep->lag ? scanned - ep->lag : 0;
+    size_t end;
+
+    /* Literal fast path */
+    if ((pattern_len > 0) && (strpbrk(pattern, "^$*+?.([%-") == NULL))
+    {
+        size_t from = scanned >= pattern_len ? scanned - pattern_len + 1 : 0;
+        const char *found = memmem(data + from, len - from, pattern, pattern_len);
+
+        if (found == NULL)
+        {
+            return 0;
+        }
+        lua_pushstring(L, pattern);
+        *results = 1;
+        return found - data + pattern_len;
+    }
+
+    if (!pattern_end_sensitive(pattern, pattern_len))
+    {
+        if (!pattern_find(L, pattern, pattern_len, data, len, &start, NULL))
+        {
+            ep->lag = len - start;
+            return 0;
+        }
+
+        end = expect_shortest_prefix(L, pattern, pattern_len, data, start, scanned + 1, len);
+        pattern_find(L, pattern, pattern_len, data, end, &start, results);
+        return end;
+    }
+
+    /* A pattern anchored at the end can only match a prefix where the
+     * pattern without anchor matches too */
+    if ((pattern[pattern_len - 1] == '$') && !pattern_end_sensitive(pattern, pattern_len - 1))
+    {
+        size_t from = start;
+
+        if (!pattern_find(L, pattern, pattern_len - 1, data, len, &from, NULL))
+        {
+            ep->lag = len - start;
+            return 0;
+        }
+    }
+
+    /* Otherwise check each new prefix, dropping start positions as they are
+     * ruled out */
+    for (end = scanned + 1; end <= len; end++)
+    {
+        if (pattern_find(L, pattern, pattern_len, data, end, &start, results))
+        {
+            return end;
+        }
+    }
+    ep->lag = len - start;
+
+    return 0;
+}
+
+typedef ssize_t (*expect_matcher_t)(lua_State *L, void *matcher, const char *data,
+                                   size_t scanned, size_t len, int *results);
+
+/* Memory owned by Lua, left on the stack, so it is released by the garbage
+ * collector even if an error is raised while it is in use */
+static void *lua_scratch(lua_State *L, size_t size)
+{
+    void *scratch = lua_newuserdata(L, size);
+
+    memset(scratch, 0, size);
+    return scratch;
+}
+
+/* Wait for matcher to find a match in received data. Returns number of match
+ * results pushed, or -1 with error message pushed on error. On timeout nil
+ * and the most recently received text are pushed.
+ */
+static int expect_wait(lua_State *L, int timeout, expect_matcher_t match, void *matcher)
+{
+    double deadline = rx_deadline(timeout);
+    char *window = lua_newuserdata(L, EXPECT_WINDOW + RX_BUFFER_SIZE);
+    size_t len = 0;
+    int results = 0;
+
+    while (true)
+    {
+        size_t scanned = len;
+        ssize_t ret, end;
+
+        ret = rx_fill(rx_remaining(deadline));
+        if (ret < 0)
+        {
+            lua_pushstring(L, strerror(errno));
+            return -1;
+        }
+        if (ret == 0)
+        {
+            // Timeout
+            lua_pushnil(L);
+            lua_pushlstring(L, window, len);
+            return 2;
+        }
+
+        memcpy(window + len, rx.data + rx.start, rx_available());
+        len += rx_available();
+
+        end = match(L, matcher, window, scanned, len, &results);
+        if (end < 0)
+        {
+            return -1;
+        }
+        if (end > 0)
+        {
+            // Consume and echo received data up to end of match only
+            rx.start += end - scanned;
+            echo(L, window + scanned, end - scanned);
+            return results;
+        }
+
+        echo(L, rx.data + rx.start, rx_available());
+        rx.start = rx.end;
+
+        // Keep bounded window of most recent data
+        if (len > EXPECT_WINDOW)
+        {
+            memmove(window, window + len - EXPECT_WINDOW, EXPECT_WINDOW);
+            len = EXPECT_WINDOW;
+        }
+    }
+}
+
+/* Like expect_wait() but matching data received for task without blocking.
+ * Only data received since the previous attempt is scanned, so matcher must
+ * keep its search state across attempts.
+ */
+static int task_expect(lua_State *L, task_t *task, int timeout, expect_matcher_t match,
+                       void *matcher)
+{
+    size_t scanned;
+    int results = 0;
+
+    task_op_begin(task, timeout);
+    scanned = task->scanned;
+
+    if ((task->rx->len > 0) && (scanned < task->rx->len))
+    {
+        ssize_t end = match(L, matcher, task->rx->str, scanned, task->rx->len, &results);
+
+        if (end < 0)
+        {
+            task->pending = false;
+            return -1;
+        }
+        if (end > 0)
+        {
+            g_string_erase(task->rx, 0, end);
+            return task_op_done(task, results);
+        }
+        task->scanned = task->rx->len;
+    }
+
+    if (task_op_timed_out(task))
+    {
+        // Consume data like expect_wait()
+        lua_pushnil(L);
+        lua_pushlstring(L, task->rx->str, task->rx->len);
+        g_string_truncate(task->rx, 0);
+        return 2;
+    }
+
+    return task_op_retry(L, task);
+}
+
+static ssize_t expect_match_pattern(lua_State *L, void *matcher, const char *data,
+                                    size_t scanned, size_t len, int *results)
+{
+    return expect_match(L, (expect_pattern_t *) matcher, data, scanned, len, results);
+}
+
+// lua: captures = tio.expect(pattern, timeout)
+static int api_expect(lua_State *L)
+{
+    expect_pattern_t pattern = EXPECT_PATTERN(luaL_checkstring(L, 1));
+    int timeout = lua_tointeger(L, 2);
+    int results;
+
+    task_t *task = task_get_blocking(L, "expect");
+    if (task != NULL)
+    {
+        // Search state is kept with task while it waits for more data
+        if (task->pending)
+        {
+            pattern.lag = task->lag;
+        }
+        results = task_expect(L, task, timeout, expect_match_pattern, &pattern);
+        task->lag = pattern.lag;
+    }
+    else
+    {
+        results = expect_wait(L, timeout, expect_match_pattern, &pattern);
+    }
+    if (results < 0)
+    {
+        return lua_error(L);
+    }
+
+    return results;
+}
+
+/* Aho-Corasick automaton, as a complete DFA, matching all literal patterns of
+ * tio.expect_any() in one pass over received data.
+ */
+typedef struct
+{
+    int (*next)[256];
+    int *match;             // Lowest index of patterns ending in state or 0
+    int *length;            // Length of that pattern
+    int state;              // Current state
+} ac_t;
+
+/* Build automaton in memory owned by Lua, left on the stack */
+static void ac_build(lua_State *L, ac_t *ac, const char **literals, const int *index, int count)
+{
+    int *fail, *queue;
+    int states = 1, head = 0, tail = 0;
+    size_t total = 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        total += strlen(literals[i]);
+    }
+
+    ac->next = lua_scratch(L, total * sizeof(*ac->next));
+    ac->match = lua_scratch(L, total * sizeof(int));
+    ac->length = lua_scratch(L, total * sizeof(int));
+    ac->state = 0;
+    fail = lua_scratch(L, total * sizeof(int));
+    queue = lua_scratch(L, total * sizeof(int));
+
+    // Build trie, state 0 being root
+    for (int i = 0; i < count; i++)
+    {
+        const unsigned char *c = (const unsigned char *) literals[i];
+        int s = 0;
+
+        for (; *c; c++)
+        {
+            if (ac->next[s][*c] == 0)
+            {
+                ac->next[s][*c] = states++;
+            }
+            s = ac->next[s][*c];
+        }
+        if ((ac->match[s] == 0) || (index[i] < ac->match[s]))
+        {
+            ac->match[s] = index[i];
+            ac->length[s] = strlen(literals[i]);
+        }
+    }
+
+    // Add failure transitions breadth first
+    for (int c = 0; c < 256; c++)
+    {
+        if (ac->next[0][c])
+        {
+            queue[tail++] = ac->next[0][c];
+        }
+    }
+    while (head < tail)
+    {
+        int r = queue[head++];
+        int f = fail[r];
+
+        if (ac->match[f] && ((ac->match[r] == 0) || (ac->match[f] < ac->match[r])))
+        {
+            ac->match[r] = ac->match[f];
+            ac->length[r] = ac->length[f];
+        }
+
+        for (int c = 0; c < 256; c++)
+        {
+            int u = ac->next[r][c];
+
+            if (u)
+            {
+                fail[u] = ac->next[f][c];
+                queue[tail++] = u;
+            }
+            else
+            {
+                ac->next[r][c] = ac->next[f][c];
+            }
+        }
+    }
+
+    // Drop fail and queue
+    lua_pop(L, 2);
+}
+
+/* Feed data to automaton. Returns end of first match or 0 if none. */
+static size_t ac_scan(ac_t *ac, const char *data, size_t start, size_t len, int *index, int *length)
+{
+    for (size_t i = start; i < len; i++)
+    {
+        ac->state = ac->next[ac->state][(unsigned char) data[i]];
+        if (ac->match[ac->state])
+        {
+            *index = ac->match[ac->state];
+            *length = ac->length[ac->state];
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct
+{
+    ac_t ac;
+    expect_pattern_t *patterns;
+    int *index;             // Their indexes in pattern list
+    int count;
+} expect_any_t;
+
+/* Find earliest match of any pattern, lowest index first if several patterns
+ * match at the same position. Pushes index and captures of match.
+ */
+static ssize_t expect_match_any(lua_State *L, void *matcher, const char *data,
+                                size_t scanned, size_t len, int *results)
+{
+    expect_any_t *any = matcher;
+    int best_index = 0, best_results = 0, length = 0;
+    ssize_t best_end;
+
+    best_end = ac_scan(&any->ac, data, scanned, len, &best_index, &length);
+
+    for (int i = 0; i < any->count; i++)
+    {
+        size_t limit = best_end > 0 ? (size_t) best_end : len;
+        ssize_t end;
+        int n = 0;
+
+        if ((best_end > 0) && (any->index[i] > best_index))
+        {
+            // Only an earlier match can win
+            limit--;
+        }
+        if (limit <= scanned)
+        {
+            continue;
+        }
+
+        end = expect_match(L, &any->patterns[i], data, scanned, limit, &n);
+        if (end < 0)
+        {
+            return -1;
+        }
+        if (end == 0)
+        {
+            continue;
+        }
+
+        // Replace results of previous best match
+        for (int j = 0; j < best_results; j++)
+        {
+            lua_remove(L, -(n + 1));
+        }
+        best_end = end;
+        best_index = any->index[i];
+        best_results = n;
+    }
+
+    if (best_end <= 0)
+    {
+        return 0;
+    }
+
+    if (best_results == 0)
+    {
+        // Literal match
+        lua_pushlstring(L, data + best_end - length, length);
+        best_results = 1;
+    }
+    lua_pushinteger(L, best_index);
+    lua_insert(L, -(best_results + 1));
+    *results = best_results + 1;
+
+    return best_end;
+}
+
+/* Build matcher for patterns in table at index arg. All its memory is kept
+ * in a table left on the stack, which also references the patterns table so
+ * the patterns stay valid while the matcher is in use.
+ */
+static expect_any_t *expect_any_new(lua_State *L, int arg)
+{
+    const char **literals;
+    int *literal_index;
+    int count = 0, literal_count = 0;
+    expect_any_t *any;
+    int anchor, n;
+
+    lua_newtable(L);
+    anchor = lua_gettop(L);
+    lua_pushvalue(L, arg);
+    lua_rawseti(L, anchor, 1);
+
+    while (true)
+    {
+        lua_rawgeti(L, arg, count + 1);
+        if (lua_isnil(L, -1))
+        {
+            lua_pop(L, 1);
+            break;
+        }
+        luaL_checkstring(L, -1);
+        lua_pop(L, 1);
+        count++;
+    }
+
+    any = lua_scratch(L, sizeof(*any));
+    literals = lua_scratch(L, (count + 1) * sizeof(char *));
+    literal_index = lua_scratch(L, (count + 1) * sizeof(int));
+    any->patterns = lua_scratch(L, (count + 1) * sizeof(expect_pattern_t));
+    any->index = lua_scratch(L, (count + 1) * sizeof(int));
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *pattern;
+
+        lua_rawgeti(L, arg, i + 1);
+        pattern = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        if ((strlen(pattern) > 0) && (strpbrk(pattern, "^$*+?.([%-") == NULL))
+        {
+            literals[literal_count] = pattern;
+            literal_index[literal_count++] = i + 1;
+        }
+        else
+        {
+            any->patterns[any->count] = EXPECT_PATTERN(pattern);
+            any->index[any->count++] = i + 1;
+        }
+    }
+
+    ac_build(L, &any->ac, literals, literal_index, literal_count);
+
+    // Move memory allocated above into anchor table
+    for (n = lua_gettop(L) - anchor + 1; n > 1; n--)
+    {
+        lua_rawseti(L, anchor, n);
+    }
+
+    return any;
+}
+
+/* Release matcher of tio.expect_any() kept with task */
+static void task_expect_any_release(lua_State *L, task_t *task)
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, task->any_ref);
+    task->any_ref = LUA_NOREF;
+    task->any = NULL;
+}
+
+/* Return matcher for tio.expect_any() in task. It is built when the operation
+ * starts and kept with task until it ends, so that the automaton and search
+ * state survive attempts and received data is scanned only once.
+ */
+static expect_any_t *task_expect_any(lua_State *L, task_t *task, int arg)
+{
+    if (task->pending && (task->any_ref != LUA_NOREF))
+    {
+        bool same;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, task->any_ref);
+        lua_rawgeti(L, -1, 1);
+        same = lua_rawequal(L, -1, arg);
+        lua_pop(L, 2);
+        if (same)
+        {
+            return task->any;
+        }
+    }
+
+    // Not a retry, start new operation
+    task_expect_any_release(L, task);
+    task->pending = false;
+    task->any = expect_any_new(L, arg);
+    task->any_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return task->any;
+}
+
+// lua: index, captures = tio.expect_any(patterns, timeout)
+static int api_expect_any(lua_State *L)
+{
+    int timeout = lua_tointeger(L, 2);
+    task_t *task = task_get_blocking(L, "expect_any");
+    int results;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    if (task != NULL)
+    {
+        results = task_expect(L, task, timeout, expect_match_any, task_expect_any(L, task, 1));
+        if (!task->pending)
+        {
+            task_expect_any_release(L, task);
+        }
+    }
+    else
+    {
+        results = expect_wait(L, timeout, expect_match_any, expect_any_new(L, 1));
+    }
+
+    if (results < 0)
+    {
+        return lua_error(L);
+    }
+
+    return results;
+}
+
+typedef size_t (*frame_encoder_t)(const uint8_t *in, size_t len, uint8_t *out);
+typedef ssize_t (*frame_decoder_t)(const uint8_t *in, size_t len, uint8_t *out);
+
+static int frame_encode(lua_State *L, frame_encoder_t encode)
+{
+    size_t len;
+    const char *data = luaL_checklstring(L, 1, &len);
+    uint8_t *out = g_malloc(2 * len + 2); // Worst case of all encodings
+
+    len = encode((const uint8_t *) data, len, out);
+    lua_pushlstring(L, (const char *) out, len);
+    g_free(out);
+
+    return 1;
+}
+
+static int frame_decode(lua_State *L, frame_decoder_t decode)
+{
+    size_t len;
+    const char *data = luaL_checklstring(L, 1, &len);
+    uint8_t *out = g_malloc(len + 1);
+    ssize_t ret;
+
+    ret = decode((const uint8_t *) data, len, out);
+    if (ret < 0)
+    {
+        g_free(out);
+        lua_pushnil(L);
+        lua_pushstring(L, "invalid frame");
+        return 2;
+    }
+
+    lua_pushlstring(L, (const char *) out, ret);
+    g_free(out);
+
+    return 1;
+}
+
+// lua: string = tio.cobs_encode(string)
+static int api_cobs_encode(lua_State *L)
+{
+    return frame_encode(L, cobs_encode);
+}
+
+// lua: string = tio.cobs_decode(string)
+static int api_cobs_decode(lua_State *L)
+{
+    return frame_decode(L, cobs_decode);
+}
+
+// lua: string = tio.slip_encode(string)
+static int api_slip_encode(lua_State *L)
+{
+    return frame_encode(L, slip_encode);
+}
+
+// lua: string = tio.slip_decode(string)
+static int api_slip_decode(lua_State *L)
+{
+    return frame_decode(L, slip_decode);
+}
+
+// lua: string = tio.hdlc_encode(string)
+static int api_hdlc_encode(lua_State *L)
+{
+    return frame_encode(L, hdlc_encode);
+}
+
+// lua: string = tio.hdlc_decode(string)
+static int api_hdlc_decode(lua_State *L)
+{
+    return frame_decode(L, hdlc_decode);
+}
+
+// lua: number = tio.crc(algorithm, string)
+static int api_crc(lua_State *L)
+{
+    size_t len;
+    const char *data = luaL_checklstring(L, 2, &len);
+    crc_t *crc;
+
+    if (lua_istable(L, 1))
+    {
+        // Custom algorithm
+        lua_getfield(L, 1, "width");
+        lua_getfield(L, 1, "poly");
+        lua_getfield(L, 1, "init");
+        lua_getfield(L, 1, "reflect");
+        lua_getfield(L, 1, "xorout");
+        int width = lua_tointeger(L, -5);
+        uint32_t poly = lua_tonumber(L, -4);
+        uint32_t init = lua_tonumber(L, -3);
+        bool reflect = lua_toboolean(L, -2);
+        uint32_t xorout = lua_tonumber(L, -1);
+
+        lua_pop(L, 5);
+        if ((width != 8) && (width != 16) && (width != 32))
+        {
+            return luaL_error(L, "CRC width must be 8, 16 or 32");
+        }
+        crc = crc_custom(width, poly, init, reflect, xorout);
+    }
+    else
+    {
+        const char *name = luaL_checkstring(L, 1);
+
+        crc = crc_find(name);
+        if (crc == NULL)
+        {
+            return luaL_error(L, "unknown CRC algorithm '%s'", name);
+        }
+    }
+
+    lua_pushnumber(L, crc_compute(crc, (const uint8_t *) data, len));
+
+    return 1;
+}
+
+static bool pack_little_endian(char c, bool little)
+{
+    static const uint16_t one = 1;
+
+    switch (c)
+    {
+        case '<':
+            return true;
+        case '>':
+            return false;
+        case '=':
+            return *(const uint8_t *) &one == 1;
+        default:
+            return little;
+    }
+}
+
+/* Size of format item, 0 if not a fixed size number */
+static size_t pack_item_size(char c)
+{
+    switch (c)
+    {
+        case 'b':
+        case 'B':
+            return 1;
+        case 'h':
+        case 'H':
+            return 2;
+        case 'i':
+        case 'I':
+        case 'f':
+            return 4;
+        case 'q':
+        case 'Q':
+        case 'd':
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static size_t pack_count(const char **format)
+{
+    size_t count = 0;
+
+    while (isdigit((unsigned char) **format))
+    {
+        count = count * 10 + (*(*format)++ - '0');
+    }
+
+    return count;
+}
+
+/* Index of next value to pack */
+static int pack_arg(lua_State *L, int *arg, int top)
+{
+    if (*arg > top)
+    {
+        luaL_error(L, "missing value for argument #%d", *arg);
+    }
+
+    return (*arg)++;
+}
+
+/* Integer argument as 64 bit two's complement value. Numbers are range
+ * checked as converting a float outside the range of the integer type is
+ * undefined. Values from 2^63 up to 2^64 are accepted for 'Q'.
+ */
+static uint64_t pack_integer(lua_State *L, int arg)
+{
+    double d;
+
+#if LUA_VERSION_NUM >= 503
+    if (lua_isinteger(L, arg))
+    {
+        return (uint64_t) lua_tointeger(L, arg);
+    }
+#endif
+
+    d = luaL_checknumber(L, arg);
+    if ((d >= -9223372036854775808.0) && (d < 9223372036854775808.0))
+    {
+        return (uint64_t) (int64_t) d;
+    }
+    if ((d >= 0) && (d < 18446744073709551616.0))
+    {
+        return (uint64_t) d;
+    }
+    luaL_argerror(L, arg, "number has no integer representation");
+
+    return 0;
+}
+
+// lua: string = tio.pack(format, ...)
+static int api_pack(lua_State *L)
+{
+    const char *format = luaL_checkstring(L, 1);
+    luaL_Buffer out;
+    bool little = pack_little_endian('=', false);
+    int top = lua_gettop(L);
+    int arg = 2;
+
+    // Buffer may use stack slots above arguments
+    luaL_buffinit(L, &out);
+
+    for (char c; (c = *format++) != '\0';)
+    {
+        size_t size = pack_item_size(c);
+        uint8_t bytes[8];
+        uint64_t value;
+
+        if (size > 0)
+        {
+            if (c == 'f')
+            {
+                float f = luaL_checknumber(L, pack_arg(L, &arg, top));
+                uint32_t u;
+
+                memcpy(&u, &f, sizeof(u));
+                value = u;
+            }
+            else if (c == 'd')
+            {
+                double d = luaL_checknumber(L, pack_arg(L, &arg, top));
+
+                memcpy(&value, &d, sizeof(value));
+            }
+            else
+            {
+                value = pack_integer(L, pack_arg(L, &arg, top));
+            }
+
+            for (size_t i = 0; i < size; i++)
+            {
+                bytes[little ? i : size - 1 - i] = value >> (8 * i);
+            }
+            luaL_addlstring(&out, (const char *) bytes, size);
+            continue;
+        }
+
+        switch (c)
+        {
+            case '<':
+            case '>':
+            case '=':
+                little = pack_little_endian(c, little);
+                break;
+
+            case 'x':
+                luaL_addchar(&out, 0);
+                break;
+
+            case 'c':
+            {
+                size_t count = pack_count(&format);
+                size_t len;
+                const char *string = luaL_checklstring(L, pack_arg(L, &arg, top), &len);
+
+                luaL_addlstring(&out, string, len < count ? len : count);
+                for (; len < count; len++)
+                {
+                    luaL_addchar(&out, 0);
+                }
+                break;
+            }
+
+            case 'z':
+            {
+                const char *string = luaL_checkstring(L, pack_arg(L, &arg, top));
+
+                luaL_addlstring(&out, string, strlen(string) + 1);
+                break;
+            }
+
+            case ' ':
+                break;
+
+            default:
+                return luaL_error(L, "invalid format option '%c'", c);
+        }
+    }
+
+    luaL_pushresult(&out);
+
+    return 1;
+}
+
+// lua: ... = tio.unpack(format, string, position)
+static int api_unpack(lua_State *L)
+{
+    const char *format = luaL_checkstring(L, 1);
+    size_t len;
+    const uint8_t *data = (const uint8_t *) luaL_checklstring(L, 2, &len);
+    size_t pos = lua_isnoneornil(L, 3) ? 0 : (size_t) luaL_checkinteger(L, 3) - 1;
+    bool little = pack_little_endian('=', false);
+    int results = 0;
+
+    for (char c; (c = *format++) != '\0';)
+    {
+        size_t size = pack_item_size(c);
+
+        if (c == 'c')
+        {
+            size = pack_count(&format);
+        }
+        else if (c == 'x')
+        {
+            size = 1;
+        }
+        else if (c == 'z')
+        {
+            const uint8_t *end = pos < len ? memchr(data + pos, 0, len - pos) : NULL;
+
+            if (end == NULL)
+            {
+                return luaL_error(L, "unfinished string");
+            }
+            size = end - (data + pos) + 1;
+        }
+
+        if (pos + size > len)
+        {
+            return luaL_error(L, "data string too short");
+        }
+        luaL_checkstack(L, 2, "too many results");
+
+        if (pack_item_size(c) > 0)
+        {
+            uint64_t value = 0;
+
+            for (size_t i = 0; i < size; i++)
+            {
+                value |= (uint64_t) data[pos + (little ? i : size - 1 - i)] << (8 * i);
+            }
+
+            switch (c)
+            {
+                case 'b':
+                    lua_pushinteger(L, (int8_t) value);
+                    break;
+                case 'h':
+                    lua_pushinteger(L, (int16_t) value);
+                    break;
+                case 'i':
+                    lua_pushinteger(L, (int32_t) value);
+                    break;
+                case 'q':
+                    lua_pushinteger(L, (int64_t) value);
+                    break;
+                case 'f':
+                {
+                    uint32_t u = value;
+                    float f;
+
+                    memcpy(&f, &u, sizeof(f));
+                    lua_pushnumber(L, f);
+                    break;
+                }
+                case 'd':
+                {
+                    double d;
+
+                    memcpy(&d, &value, sizeof(d));
+                    lua_pushnumber(L, d);
+                    break;
+                }
+                default:
+                    lua_pushinteger(L, (lua_Integer) value);
+                    break;
+            }
+            results++;
+        }
+        else switch (c)
+        {
+            case '<':
+            case '>':
+            case '=':
+                little = pack_little_endian(c, little);
+                break;
+
+            case 'c':
+                lua_pushlstring(L, (const char *) data + pos, size);
+                results++;
+                break;
+
+            case 'z':
+                lua_pushlstring(L, (const char *) data + pos, size - 1);
+                results++;
+                break;
+
+            case 'x':
+            case ' ':
+                break;
+
+            default:
+                return luaL_error(L, "invalid format option '%c'", c);
+        }
+
+        pos += size;
+    }
+
+    lua_pushinteger(L, pos + 1);
+
+    return results + 1;
+}
+
+typedef struct
+{
+    const char *name;
+    uint8_t delimiter;
+    frame_decoder_t decode;
+} frame_decoder_entry_t;
+
+static const frame_decoder_entry_t frame_decoders[] =
+{
+    { "cobs", COBS_DELIMITER, cobs_decode },
+    { "slip", SLIP_END, slip_decode },
+    { "hdlc", HDLC_FLAG, hdlc_decode },
+    { NULL, 0, NULL },
+};
+
+/* Find first non-empty valid frame ending in data. Invalid frames are skipped. */
+static ssize_t frame_match(lua_State *L, void *matcher, const char *data,
+                           size_t scanned, size_t len, int *results)
+{
+    const frame_decoder_entry_t *decoder = matcher;
+    const char *last = scanned > 0 ? memrchr(data, decoder->delimiter, scanned) : NULL;
+    size_t start = last ? (size_t) (last - data) + 1 : 0;
+    size_t pos = scanned;
+
+    while (pos < len)
+    {
+        const char *delimiter = memchr(data + pos, decoder->delimiter, len - pos);
+        size_t end;
+
+        if (delimiter == NULL)
+        {
+            break;
+        }
+        end = delimiter - data;
+
+        if (end > start)
+        {
+            uint8_t *frame = lua_newuserdata(L, end - start);
+            ssize_t ret = decoder->decode((const uint8_t *) data + start, end - start, frame);
+
+            if (ret > 0)
+            {
+                lua_pushlstring(L, (const char *) frame, ret);
+                lua_remove(L, -2);
+                *results = 1;
+                return end + 1;
+            }
+            lua_pop(L, 1);
+        }
+
+        start = pos = end + 1;
+    }
+
+    return 0;
+}
+
+// lua: string = tio.read_frame(decoder, timeout)
+static int api_read_frame(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    int timeout = lua_tointeger(L, 2);
+    const frame_decoder_entry_t *decoder;
+    task_t *task = task_get_blocking(L, "read_frame");
+    int results;
+
+    for (decoder = frame_decoders; decoder->name != NULL; decoder++)
+    {
+        if (strcmp(decoder->name, name) == 0)
+        {
+            break;
+        }
+    }
+    if (decoder->name == NULL)
+    {
+        return luaL_error(L, "unknown frame decoder '%s'", name);
+    }
+
+    if (task != NULL)
+    {
+        results = task_expect(L, task, timeout, frame_match, (void *) decoder);
+    }
+    else
+    {
+        results = expect_wait(L, timeout, frame_match, (void *) decoder);
+    }
+    if (results < 0)
+    {
+        return lua_error(L);
+    }
+
+    // Return only nil on timeout
+    if ((results == 2) && lua_isnil(L, -2))
+    {
+        lua_pop(L, 1);
+        results = 1;
+    }
+
+    return results;
+}
+
+/* Hooks called by main loop on data received from or sent to device */
+typedef enum
+{
+    HOOK_RX,
+    HOOK_TX,
+    HOOK_LINE,
+    HOOK_MATCH,
+    HOOK_END,
+} hook_type_t;
+
+static const char *hook_names[HOOK_END] = { "on_rx", "on_tx", "on_line", "on_match" };
+
+static struct
+{
+    unsigned long calls;
+    unsigned long errors;
+    double time;            // Total time spent in hook [s]
+    double time_max;        // Longest time spent in single call [s]
+} hook_stats[HOOK_END];
+
+typedef struct
+{
+    char *pattern;
+    int function;           // Registry reference of function
+    GString *window;        // Recently received data not yet matched
+    size_t lag;             // Search state, see expect_pattern_t
+} match_hook_t;
+
+static int hook_function[HOOK_MATCH] = { LUA_NOREF, LUA_NOREF, LUA_NOREF };
+static bool hook_view[HOOK_MATCH];   // Pass data as pointer and length
+static GList *match_hooks = NULL;
+static GString *hook_line = NULL;
+static GString *hook_output = NULL;
+
+/* Hook being dispatched, see script_dispatch() */
+static struct
+{
+    hook_type_t type;
+    int *function;
+} hook_current;
+
+/* Unregister hook after error, with error message on top of stack */
+static void hook_disable(lua_State *L, hook_type_t type, int *function)
+{
+    tio_warning_printf("Disabled %s hook (%s)", hook_names[type], lua_tostring(L, -1));
+    script_limits_print();
+    lua_pop(L, 1);
+    hook_stats[type].errors++;
+    luaL_unref(L, LUA_REGISTRYINDEX, *function);
+    *function = LUA_NOREF;
+}
+
+/* Note hook about to be passed data, disabled if that fails */
+static void hook_begin(hook_type_t type, int *function)
+{
+    hook_current.type = type;
+    hook_current.function = function;
+}
+/* Call hook function with nargs arguments on stack within time budget.
+ * Returns true with nresults results on stack on success. On error the hook
+ * is unregistered.
+ */
+static bool hook_call(lua_State *L, hook_type_t type, int *function, int nargs, int nresults)
+{
+    double start = get_current_time();
+    double time;
+    int error;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, *function);
+    lua_insert(L, -(nargs + 1));
+
+    hook_deadline = start + HOOK_BUDGET / 1000.0;
+    error = lua_pcall(L, nargs, nresults, 0);
+    hook_deadline = 0;
+
+    time = get_current_time() - start;
+    hook_stats[type].calls++;
+    hook_stats[type].time += time;
+    if (time > hook_stats[type].time_max)
+    {
+        hook_stats[type].time_max = time;
+    }
+
+    if (error)
+    {
+        hook_disable(L, type, function);
+        return false;
+    }
+
+    return true;
+}
+
+/* Pass data through rx/tx hook. Returns true if data was replaced by content
+ * of hook_output.
+ */
+static bool hook_filter(lua_State *L, hook_type_t type, const char *data, size_t len)
+{
+    bool replaced = false;
+    int nargs = 1;
+
+    hook_begin(type, &hook_function[type]);
+    if (hook_view[type])
+    {
+        // Zero-copy view of data, valid during call only
+        lua_pushlightuserdata(L, (void *) data);
+        lua_pushinteger(L, len);
+        nargs = 2;
+    }
+    else
+    {
+        lua_pushlstring(L, data, len);
+    }
+    if (!hook_call(L, type, &hook_function[type], nargs, 1))
+    {
+        return false;
+    }
+
+    if (lua_isstring(L, -1))
+    {
+        // Rewrite data
+        size_t new_len;
+        const char *new_data = lua_tolstring(L, -1, &new_len);
+
+        g_string_truncate(hook_output, 0);
+        g_string_append_len(hook_output, new_data, new_len);
+        replaced = true;
+    }
+    else if (lua_isboolean(L, -1) && !lua_toboolean(L, -1))
+    {
+        // Drop data
+        g_string_truncate(hook_output, 0);
+        replaced = true;
+    }
+    lua_pop(L, 1);
+
+    return replaced;
+}
+
+static void hook_lines(lua_State *L, const char *data, size_t len)
+{
+    hook_begin(HOOK_LINE, &hook_function[HOOK_LINE]);
+    while ((len > 0) && (hook_function[HOOK_LINE] != LUA_NOREF))
+    {
+        const char *newline = memchr(data, '\n', len);
+        size_t n = newline ? (size_t) (newline - data) : len;
+
+        g_string_append_len(hook_line, data, n);
+        if (newline == NULL)
+        {
+            // Deliver overlong lines in parts
+            if (hook_line->len > EXPECT_WINDOW)
+            {
+                lua_pushlstring(L, hook_line->str, hook_line->len);
+                hook_call(L, HOOK_LINE, &hook_function[HOOK_LINE], 1, 0);
+                g_string_truncate(hook_line, 0);
+            }
+            return;
+        }
+
+        if ((hook_line->len > 0) && (hook_line->str[hook_line->len - 1] == '\r'))
+        {
+            g_string_truncate(hook_line, hook_line->len - 1);
+        }
+        lua_pushlstring(L, hook_line->str, hook_line->len);
+        g_string_truncate(hook_line, 0);
+        hook_call(L, HOOK_LINE, &hook_function[HOOK_LINE], 1, 0);
+
+        data += n + 1;
+        len -= n + 1;
+    }
+}
+
+/* Match hook pattern against its window, in protected mode so an error in
+ * the pattern only disables the hook */
+static int hook_match_pattern(lua_State *L)
+{
+    match_hook_t *hook = lua_touserdata(L, 1);
+    size_t scanned = lua_tointeger(L, 2);
+    expect_pattern_t pattern = { hook->pattern, hook->lag };
+    int results = 0;
+    ssize_t end;
+
+    lua_settop(L, 0);
+    end = expect_match(L, &pattern, hook->window->str, scanned, hook->window->len, &results);
+    hook->lag = pattern.lag;
+    if (end == 0)
+    {
+        return 0;
+    }
+
+    lua_pushinteger(L, end);
+    lua_insert(L, 1);
+    return results + 1;
+}
+
+static void hook_matches(lua_State *L, const char *data, size_t len)
+{
+    for (GList *iter = match_hooks; iter != NULL; iter = iter->next)
+    {
+        match_hook_t *hook = iter->data;
+        size_t scanned = hook->window->len;
+
+        g_string_append_len(hook->window, data, len);
+
+        while (hook->function != LUA_NOREF)
+        {
+            int top = lua_gettop(L);
+            int results;
+            ssize_t end;
+
+            hook_begin(HOOK_MATCH, &hook->function);
+            lua_pushcfunction(L, hook_match_pattern);
+            lua_pushlightuserdata(L, hook);
+            lua_pushinteger(L, scanned);
+            if (lua_pcall(L, 2, LUA_MULTRET, 0) != 0)
+            {
+                hook_disable(L, HOOK_MATCH, &hook->function);
+                break;
+            }
+            if (lua_gettop(L) == top)
+            {
+                break;
+            }
+            end = lua_tointeger(L, top + 1);
+            lua_remove(L, top + 1);
+            results = lua_gettop(L) - top;
+
+            // Call hook with captures and continue matching after match
+            g_string_erase(hook->window, 0, end);
+            scanned = 0;
+            hook->lag = SIZE_MAX;
+            hook_call(L, HOOK_MATCH, &hook->function, results, 0);
+        }
+
+        // Keep bounded window of most recent data
+        if (hook->window->len > EXPECT_WINDOW)
+        {
+            g_string_erase(hook->window, 0, hook->window->len - EXPECT_WINDOW);
+        }
+    }
+}
+
+static void match_hook_free(gpointer data)
+{
+    match_hook_t *hook = data;
+
+    g_free(hook->pattern);
+    g_string_free(hook->window, true);
+    g_free(hook);
+}
+
+/* Remove match hooks unregistered or disabled during dispatch */
+static void match_hooks_sweep(void)
+{
+    GList *iter = match_hooks;
+
+    while (iter != NULL)
+    {
+        GList *next = iter->next;
+        match_hook_t *hook = iter->data;
+
+        if (hook->function == LUA_NOREF)
+        {
+            match_hook_free(hook);
+            match_hooks = g_list_delete_link(match_hooks, iter);
+        }
+        iter = next;
+    }
+}
+
+static int hook_set(lua_State *L, hook_type_t type)
+{
+    bool view = (type != HOOK_LINE) && lua_toboolean(L, 2);
+
+    if (!lua_isnoneornil(L, 1))
+    {
+        luaL_checktype(L, 1, LUA_TFUNCTION);
+    }
+
+#ifndef HAVE_LUAJIT
+    if (view)
+    {
+        return luaL_error(L, "buffer views require LuaJIT");
+    }
+#endif
+    hook_view[type] = view;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, hook_function[type]);
+    hook_function[type] = LUA_NOREF;
+
+    if (!lua_isnoneornil(L, 1))
+    {
+        lua_pushvalue(L, 1);
+        hook_function[type] = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    if (hook_line == NULL)
+    {
+        hook_line = g_string_new("");
+        hook_output = g_string_new("");
+    }
+
+    return 0;
+}
+
+// lua: tio.on_rx(function, view)
+static int api_on_rx(lua_State *L)
+{
+    return hook_set(L, HOOK_RX);
+}
+
+// lua: tio.on_tx(function, view)
+static int api_on_tx(lua_State *L)
+{
+    return hook_set(L, HOOK_TX);
+}
+
+// lua: tio.on_line(function)
+static int api_on_line(lua_State *L)
+{
+    hook_set(L, HOOK_LINE);
+    g_string_truncate(hook_line, 0);
+
+    return 0;
+}
+
+// lua: tio.on_match(pattern, function)
+static int api_on_match(lua_State *L)
+{
+    const char *pattern = luaL_checkstring(L, 1);
+    match_hook_t *hook;
+
+    if (!lua_isnoneornil(L, 2))
+    {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    // Replace any existing hook for pattern
+    for (GList *iter = match_hooks; iter != NULL; iter = iter->next)
+    {
+        hook = iter->data;
+        if ((hook->function != LUA_NOREF) && (strcmp(hook->pattern, pattern) == 0))
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, hook->function);
+            hook->function = LUA_NOREF;
+        }
+    }
+
+    if (!lua_isnoneornil(L, 2))
+    {
+        hook = g_new0(match_hook_t, 1);
+        hook->pattern = g_strdup(pattern);
+        hook->window = g_string_new("");
+        lua_pushvalue(L, 2);
+        hook->function = luaL_ref(L, LUA_REGISTRYINDEX);
+        match_hooks = g_list_append(match_hooks, hook);
+    }
+
+    if (hook_line == NULL)
+    {
+        hook_line = g_string_new("");
+        hook_output = g_string_new("");
+    }
+
+    return 0;
+}
+
+static void task_free(lua_State *L, task_t *task)
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, task->ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->any_ref);
+    g_string_free(task->rx, true);
+    g_free(task);
+}
 
-    if (timeout == 0)
+/* Stop tasks of previous script run, which would otherwise keep running
+ * alongside the ones spawned again by the next run */
+static void tasks_cancel(lua_State *L)
+{
+    unsigned int count = g_list_length(tasks);
+
+    for (GList *iter = tasks; iter != NULL; iter = iter->next)
     {
-        timeout = -1; // Wait forever
+        task_free(L, iter->data);
     }
+    g_list_free(tasks);
+    tasks = NULL;
 
-    luaL_Buffer buffer;
-    luaL_buffinit(L, &buffer);
+    if (count > 0)
+    {
+        tio_printf("Stopped %u tasks of previous script run", count);
+    }
+}
 
-#if LUA_VERSION_NUM >= 502
-    char *p = luaL_prepbuffsize(&buffer, size);
+/* Resume task until it yields within time budget. Returns false if task
+ * finished or failed.
+ */
+static bool task_resume(lua_State *L, task_t *task, int nargs)
+{
+    task_t *previous = task_current;
+    double previous_deadline = hook_deadline;
+    int status;
+
+    task->wake = 0;
+    task->wait_rx = false;
+    task->rx_new = false;
+
+    task_current = task;
+    hook_deadline = get_current_time() + HOOK_BUDGET / 1000.0;
+#if LUA_VERSION_NUM >= 504
+    int nresults;
+    status = lua_resume(task->thread, L, nargs, &nresults);
+#elif LUA_VERSION_NUM >= 502
+    status = lua_resume(task->thread, L, nargs);
 #else
-    if (size > LUAL_BUFFERSIZE)
-        return luaL_error(L, "buffer overflow, max size is: %d", LUAL_BUFFERSIZE);
-    char *p = luaL_prepbuffer(&buffer);
+    status = lua_resume(task->thread, nargs);
 #endif
+    hook_deadline = previous_deadline;
+    task_current = previous;
 
-    ssize_t ret = read_poll(device_fd, p, size, timeout);
-    if (ret < 0)
-        return luaL_error(L, "%s", strerror(errno));
+    if (tx_flush(false) < 0)
+    {
+        tio_warning_printf("Could not write to tty device (%s)", strerror(errno));
+    }
 
-    luaL_addsize(&buffer, ret);
-    luaL_pushresult(&buffer);
+    if (status == LUA_YIELD)
+    {
+        if (!task->wait_rx && (task->wake == 0))
+        {
+            // Plain coroutine.yield(), run again soon
+            task->wake = get_current_time();
+        }
+        lua_settop(task->thread, 0);
+        return true;
+    }
 
-    if (ret == 0)
+    if (status != 0)
     {
-        // On timeout return nil instead of an empty string
-        lua_pop(L, 1);
-        lua_pushnil(L);
+        tio_warning_printf("Task failed (%s)", lua_tostring(task->thread, -1));
+        script_limits_print();
+    }
+
+    return false;
+}
+
+// lua: tio.spawn(function, ...)
+static int api_spawn(lua_State *L)
+{
+    int nargs = lua_gettop(L) - 1;
+    task_t *task;
+
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    task = g_new0(task_t, 1);
+    task->thread = lua_newthread(L);
+    task->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    task->rx = g_string_new("");
+    task->any_ref = LUA_NOREF;
+
+    // Move function and arguments to task and run it until it yields
+    lua_xmove(L, task->thread, nargs + 1);
+    if (task_resume(L, task, nargs))
+    {
+        tasks = g_list_append(tasks, task);
     }
     else
     {
-        maybe_echo(L);
+        task_free(L, task);
     }
 
-    return 1;
+    return 0;
 }
 
-// lua: string = tio.readline(timeout)
-static int api_readline(lua_State *L) {
-    int timeout = lua_tointeger(L, 1); //ms
-    luaL_Buffer b;
-    char ch;
+/* Resume tasks which are due */
+static void tasks_run(lua_State *L)
+{
+    // Tasks spawned meanwhile have already run
+    GList *due = g_list_copy(tasks);
 
-    if (timeout == 0)
+    for (GList *iter = due; iter != NULL; iter = iter->next)
     {
-        timeout = -1; // Wait forever
+        task_t *task = iter->data;
+        double now = get_current_time();
+
+        if ((task->wait_rx && task->rx_new) || ((task->wake != 0) && (now >= task->wake)))
+        {
+            if (!task_resume(L, task, 0))
+            {
+                tasks = g_list_remove(tasks, task);
+                task_free(L, task);
+            }
+        }
     }
 
-    luaL_buffinit(L, &b);
-    luaL_prepbuffer(&b);
-    while (true) {
-        int ret = read_poll(device_fd, &ch, 1, timeout);
+    g_list_free(due);
+}
 
-        if (ret < 0)
-            return luaL_error(L, "%s", strerror(errno));
+/* Pass received data to tasks waiting for it. Data received while a task
+ * does something else is not buffered, so it can not be matched by a later
+ * read or expect.
+ */
+static void tasks_feed(const char *data, size_t len)
+{
+    for (GList *iter = tasks; iter != NULL; iter = iter->next)
+    {
+        task_t *task = iter->data;
 
-        if (ret == 0)
+        if (!task->pending)
         {
-            luaL_pushresult(&b);
-            maybe_echo(L);
-            lua_pushnil(L);
-            lua_insert(L, -2);
-            return 2;
+            continue;
         }
 
-        if (ch == '\n')
+        g_string_append_len(task->rx, data, len);
+        task->rx_new = true;
+
+        // Keep bounded amount of unconsumed data
+        if (task->rx->len > EXPECT_WINDOW)
         {
-            luaL_pushresult(&b);
-            maybe_echo(L);
-            return 1;
-        }
+            size_t excess = task->rx->len - EXPECT_WINDOW;
 
-        luaL_addchar(&b, ch);
+            g_string_erase(task->rx, 0, excess);
+            task->scanned = task->scanned > excess ? task->scanned - excess : 0;
+        }
     }
 }
 
@@ -361,10 +2568,8 @@ static int api_readline(lua_State *L) {
 static int api_ttysearch(lua_State *L)
 {
     UNUSED(L);
-    GList *iter;
-    int i = 1;
 
-    GList *device_list = tty_search_for_serial_devices();
+    GPtrArray *device_list = tty_search_for_serial_devices();
 
     if (device_list == NULL)
     {
@@ -375,9 +2580,9 @@ static int api_ttysearch(lua_State *L)
     lua_newtable(L);
 
     // Iterate through found devices
-    for (iter = device_list; iter != NULL; iter = g_list_next(iter))
+    for (guint i = 0; i < device_list->len; i++)
     {
-        device_t *device = (device_t *) iter->data;
+        device_t *device = g_ptr_array_index(device_list, i);
 
         // Create a new sub-table for each serial device
         lua_newtable(L);
@@ -404,37 +2609,104 @@ static int api_ttysearch(lua_State *L)
         lua_settable(L, -3);
 
         // Set the sub-table as a row in the main table
-        lua_rawseti(L, -2, i++);
+        lua_rawseti(L, -2, i + 1);
     }
 
     // Return table
     return 1;
 }
 
+/* Push compiled chunk cached under key if its stamp is unchanged. Returns
+ * false, pushing nothing, if chunk must be (re)compiled.
+ */
+static bool chunk_cache_get(lua_State *L, const char *key, const char *stamp)
+{
+    bool found = false;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, CHUNK_CACHE);
+    lua_getfield(L, -1, key);
+    if (lua_istable(L, -1))
+    {
+        lua_getfield(L, -1, "stamp");
+        if (strcmp(lua_tostring(L, -1), stamp) == 0)
+        {
+            lua_getfield(L, -2, "chunk");
+            lua_replace(L, -4);
+            found = true;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, found ? 1 : 2);
+
+    return found;
+}
+
+/* Cache compiled chunk on top of stack, leaving it on the stack */
+static void chunk_cache_set(lua_State *L, const char *key, const char *stamp)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, CHUNK_CACHE);
+    lua_newtable(L);
+    lua_pushstring(L, stamp);
+    lua_setfield(L, -2, "stamp");
+    lua_pushvalue(L, -3);
+    lua_setfield(L, -2, "chunk");
+    lua_setfield(L, -2, key);
+    lua_pop(L, 1);
+}
+
 static void script_buffer_run(lua_State *L, const char *script_buffer)
 {
-    int error;
+    int error = 0;
+
+    if (!chunk_cache_get(L, "=buffer", script_buffer))
+    {
+        error = luaL_loadbuffer(L, script_buffer, strlen(script_buffer), "tio");
+        if (!error)
+        {
+            chunk_cache_set(L, "=buffer", script_buffer);
+        }
+    }
 
-    error = luaL_loadbuffer(L, script_buffer, strlen(script_buffer), "tio") ||
-        lua_pcall(L, 0, 0, 0);
+    error = error || lua_pcall(L, 0, 0, 0);
     if (error)
     {
-        tio_warning_printf("lua: %s\n", lua_tostring(L, -1));
+        script_error_print(L);
         lua_pop(L, 1);  /* Pop error message from the stack */
     }
 }
 
 static void script_file_run(lua_State *L, const char *filename)
 {
+    struct stat st;
+    char stamp[64] = "";
+    int error = 0;
+
     if (strlen(filename) == 0)
     {
         tio_warning_printf("Missing script filename\n");
         return;
     }
 
-    if (luaL_dofile(L, filename))
+    /* Only recompile script if file has changed since last run */
+    if (stat(filename, &st) == 0)
+    {
+        snprintf(stamp, sizeof(stamp), "%lld:%llu:%lld", (long long) st.st_mtime,
+                 (unsigned long long) st.st_ino, (long long) st.st_size);
+    }
+
+    if ((stamp[0] == 0) || !chunk_cache_get(L, filename, stamp))
+    {
+        error = luaL_loadfile(L, filename);
+        if (!error && stamp[0] != 0)
+        {
+            chunk_cache_set(L, filename, stamp);
+        }
+    }
+
+    error = error || lua_pcall(L, 0, LUA_MULTRET, 0);
+    if (error)
     {
-        tio_warning_printf("lua: %s", lua_tostring(L, -1));
+        script_error_print(L);
         lua_pop(L, 1);  /* pop error message from the stack */
         return;
     }
@@ -448,9 +2720,27 @@ static const struct luaL_Reg tio_lib[] =
     { "line_set", line_set},
     { "send", api_send},
     { "write", api_write},
+    { "flush", api_flush},
     { "read", api_read},
     { "readline", api_readline},
+    { "expect", api_expect},
+    { "expect_any", api_expect_any},
     { "ttysearch", api_ttysearch},
+    { "on_rx", api_on_rx},
+    { "on_tx", api_on_tx},
+    { "on_line", api_on_line},
+    { "on_match", api_on_match},
+    { "spawn", api_spawn},
+    { "pack", api_pack},
+    { "unpack", api_unpack},
+    { "crc", api_crc},
+    { "cobs_encode", api_cobs_encode},
+    { "cobs_decode", api_cobs_decode},
+    { "slip_encode", api_slip_encode},
+    { "slip_decode", api_slip_decode},
+    { "hdlc_encode", api_hdlc_encode},
+    { "hdlc_decode", api_hdlc_decode},
+    { "read_frame", api_read_frame},
     {NULL, NULL}
 };
 
@@ -480,6 +2770,7 @@ static void script_set_globals(lua_State *L)
     script_set_global(L, "XMODEM_CRC", XMODEM_CRC);
     script_set_global(L, "XMODEM_1K", XMODEM_1K);
     script_set_global(L, "YMODEM", YMODEM);
+    script_set_global(L, "KERMIT", KERMIT);
 }
 
 #if LUA_VERSION_NUM >= 502
@@ -490,20 +2781,38 @@ static int luaopen_tio(lua_State *L)
 }
 #endif
 
-void script_run(int fd, const char *script_filename)
+/* Create Lua state shared by all script runs of the session */
+static lua_State *script_state_get(void)
 {
     lua_State *L;
 
-    device_fd = fd;
+    if (script_state != NULL)
+    {
+        return script_state;
+    }
 
-    L = luaL_newstate();
+    memory.limit = (size_t) option.script_memory_limit * 1024 * 1024;
+    L = lua_newstate(script_alloc, NULL);
+    if (L == NULL)
+    {
+        // Custom allocators are not supported by some LuaJIT builds
+        L = luaL_newstate();
+        if (memory.limit > 0)
+        {
+            tio_warning_printf("Script memory limit not supported by Lua library");
+        }
+    }
+    lua_atpanic(L, script_panic);
     luaL_openlibs(L);
+    lua_sethook(L, script_count_hook, LUA_MASKCOUNT, HOOK_COUNT);
 
 #if LUA_VERSION_NUM >= 502
     luaL_requiref(L, "tio", luaopen_tio, 1);
 #else
     luaL_register(L, "tio", tio_lib);
 #endif
+    lua_pushlightuserdata(L, &task_retry_marker);
+    lua_setfield(L, -2, "_retry");
     lua_pop(L, 1);
 
     // Load lua init script
@@ -512,6 +2821,53 @@ void script_run(int fd, const char *script_filename)
     // Initialize globals
     script_set_globals(L);
 
+    // Create compiled chunk cache
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, CHUNK_CACHE);
+
+    script_state = L;
+
+    return L;
+}
+
+/* Data passed to and from dispatch functions */
+typedef struct
+{
+    const char *data;
+    size_t len;
+} script_data_t;
+
+/* Run dispatch function in protected mode, so that no Lua error, including
+ * running out of script memory while passing data to a hook, reaches the
+ * Lua panic handler. Such an error disables the hook being dispatched.
+ */
+static void script_dispatch(lua_State *L, lua_CFunction function, void *arg)
+{
+    hook_current.function = NULL;
+
+    if (script_pcall(L, function, arg) != 0)
+    {
+        if ((hook_current.function != NULL) && (*hook_current.function != LUA_NOREF))
+        {
+            hook_disable(L, hook_current.type, hook_current.function);
+        }
+        else
+        {
+            script_error_print(L);
+        }
+    }
+
+    hook_current.function = NULL;
+    lua_settop(L, 0);
+}
+
+static int script_run_dispatch(lua_State *L)
+{
+    const char *script_filename = lua_touserdata(L, 1);
+
+    lua_settop(L, 0);
+    tasks_cancel(L);
+
     if (script_filename != NULL)
     {
         tio_printf("Running script %s", script_filename);
@@ -527,8 +2883,212 @@ void script_run(int fd, const char *script_filename)
         tio_printf("Running script");
         script_buffer_run(L, option.script);
     }
+    lua_settop(L, 0);
+
+    // Print data read ahead but not consumed by script
+    if (rx_available() > 0)
+    {
+        lua_pushlstring(L, rx.data + rx.start, rx_available());
+        rx.start = rx.end;
+        api_echo(L);
+    }
+
+    return 0;
+}
+
+void script_run(int fd, const char *script_filename)
+{
+    lua_State *L = script_state_get();
+
+    device_fd = fd;
+    instructions = 0;
+    instruction_limit = option.script_instruction_limit;
+
+    script_dispatch(L, script_run_dispatch, (void *) script_filename);
+
+    instruction_limit = 0;
+
+    if (tx_flush(false) < 0)
+    {
+        tio_warning_printf("Could not write to tty device (%s)", strerror(errno));
+    }
+}
+
+bool script_hooks_rx_active(void)
+{
+    return (hook_function[HOOK_RX] != LUA_NOREF) ||
+           (hook_function[HOOK_LINE] != LUA_NOREF) ||
+           (match_hooks != NULL) ||
+           (tasks != NULL);
+}
+
+bool script_hooks_tx_active(void)
+{
+    return hook_function[HOOK_TX] != LUA_NOREF;
+}
+
+static int hooks_rx_dispatch(lua_State *L)
+{
+    script_data_t *rx_data = lua_touserdata(L, 1);
+
+    lua_settop(L, 0);
+
+    if ((hook_function[HOOK_RX] != LUA_NOREF) && hook_filter(L, HOOK_RX, rx_data->data, rx_data->len))
+    {
+        rx_data->data = hook_output->str;
+        rx_data->len = hook_output->len;
+    }
+
+    hook_lines(L, rx_data->data, rx_data->len);
+    hook_matches(L, rx_data->data, rx_data->len);
+    hook_current.function = NULL;
+
+    tasks_feed(rx_data->data, rx_data->len);
+    tasks_run(L);
+
+    return 0;
+}
+
+const char *script_hooks_rx(int fd, const char *data, size_t *len)
+{
+    lua_State *L = script_state_get();
+    script_data_t rx_data = { data, *len };
+
+    device_fd = fd;
+
+    script_dispatch(L, hooks_rx_dispatch, &rx_data);
+    match_hooks_sweep();
+
+    if (tx_flush(false) < 0)
+    {
+        tio_warning_printf("Could not write to tty device (%s)", strerror(errno));
+    }
+
+    *len = rx_data.len;
+    return rx_data.data;
+}
+
+static int hooks_tx_dispatch(lua_State *L)
+{
+    script_data_t *tx_data = lua_touserdata(L, 1);
+
+    lua_settop(L, 0);
+
+    if (hook_filter(L, HOOK_TX, tx_data->data, tx_data->len))
+    {
+        tx_data->data = hook_output->str;
+        tx_data->len = hook_output->len;
+    }
+
+    return 0;
+}
+
+const char *script_hooks_tx(int fd, const char *data, size_t *len)
+{
+    lua_State *L = script_state_get();
+    script_data_t tx_data = { data, *len };
+
+    device_fd = fd;
+
+    script_dispatch(L, hooks_tx_dispatch, &tx_data);
+
+    if (tx_flush(false) < 0)
+    {
+        tio_warning_printf("Could not write to tty device (%s)", strerror(errno));
+    }
+
+    *len = tx_data.len;
+    return tx_data.data;
+}
+
+int script_tasks_timeout(void)
+{
+    double wake = 0;
+
+    for (GList *iter = tasks; iter != NULL; iter = iter->next)
+    {
+        task_t *task = iter->data;
+
+        if ((task->wake != 0) && ((wake == 0) || (task->wake < wake)))
+        {
+            wake = task->wake;
+        }
+    }
+
+    return rx_remaining(wake);
+}
+
+/* Echo and pass data received while finishing tasks, if any, then run
+ * tasks */
+static int tasks_dispatch(lua_State *L)
+{
+    script_data_t *rx_data = lua_touserdata(L, 1);
+
+    lua_settop(L, 0);
+
+    if (rx_data->len > 0)
+    {
+        lua_pushlstring(L, rx_data->data, rx_data->len);
+        api_echo(L);
+        lua_pop(L, 1);
+        tasks_feed(rx_data->data, rx_data->len);
+    }
+    tasks_run(L);
+
+    return 0;
+}
+
+void script_tasks_run(int fd)
+{
+    script_data_t rx_data = { NULL, 0 };
+
+    if (tasks == NULL)
+    {
+        return;
+    }
+
+    device_fd = fd;
+    script_dispatch(script_state_get(), tasks_dispatch, &rx_data);
+}
+
+void script_tasks_finish(int fd)
+{
+    lua_State *L = script_state_get();
+    char buffer[BUFSIZ];
+
+    device_fd = fd;
+
+    while (tasks != NULL)
+    {
+        script_data_t rx_data = { buffer, 0 };
+        ssize_t ret = read_poll(fd, buffer, sizeof(buffer), script_tasks_timeout());
+
+        if (ret < 0)
+        {
+            tio_warning_printf("Could not read from tty device (%s)", strerror(errno));
+            break;
+        }
+        rx_data.len = ret;
+        script_dispatch(L, tasks_dispatch, &rx_data);
+    }
+}
+
+void script_hooks_statistics_print(void)
+{
+    for (int i = 0; i < HOOK_END; i++)
+    {
+        if (hook_stats[i].calls == 0)
+        {
+            continue;
+        }
 
-    lua_close(L);
+        tio_printf(" Script %s: %lu calls, %.3f ms average, %.3f ms max, %lu errors",
+                   hook_names[i],
+                   hook_stats[i].calls,
+                   hook_stats[i].time * 1000 / hook_stats[i].calls,
+                   hook_stats[i].time_max * 1000,
+                   hook_stats[i].errors);
+    }
 }
 
 const char *script_run_state_to_string(script_run_t state)
@@ -21,6 +21,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef enum
 {
     SCRIPT_RUN_ONCE,
@@ -31,3 +34,11 @@ typedef enum
 
 void script_run(int fd, const char *script_filename);
 const char *script_run_state_to_string(script_run_t state);
+bool script_hooks_rx_active(void);
+bool script_hooks_tx_active(void);
+const char *script_hooks_rx(int fd, const char *data, size_t *len);
+const char *script_hooks_tx(int fd, const char *data, size_t *len);
+void script_hooks_statistics_print(void);
+int script_tasks_timeout(void);
+void script_tasks_run(int fd);
+void script_tasks_finish(int fd);
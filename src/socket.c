@@ -21,6 +21,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
@@ -35,11 +36,23 @@
 #include "print.h"
 #include "tty.h"
 
-#define MAX_SOCKET_CLIENTS 16
+#define SOCKET_CLIENTS_INITIAL 16
 #define SOCKET_PORT_DEFAULT 3333
+#define SOCKET_CLIENT_QUEUE_MAX (1024 * 1024) // Max. data queued for a slow client
+
+/* Clients are non-blocking. Data a client does not accept at once is queued
+ * and sent when it becomes writable, a client falling too far behind is
+ * disconnected so it can not stall the main loop. */
+typedef struct
+{
+    int fd;                 // -1 if slot is free
+    GString *queue;         // Data not yet accepted by client
+} socket_client_t;
 
 static int sockfd;
-static int clientfds[MAX_SOCKET_CLIENTS];
+static socket_client_t *clients = NULL;
+static int numclients = 0;
+static void (*connect_handler)(int fd) = NULL;
 static int socket_family = AF_UNSPEC;
 static int port_number = SOCKET_PORT_DEFAULT;
 
@@ -244,13 +257,12 @@ void socket_configure(void)
     }
 
     /* Listen */
-    if (listen(sockfd, MAX_SOCKET_CLIENTS) < 0)
+    if (listen(sockfd, SOMAXCONN) < 0)
     {
         tio_error_printf("Failed to listen on socket (%s)", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    memset(clientfds, -1, sizeof(clientfds));
     atexit(socket_exit);
 
     if (socket_family == AF_UNIX)
@@ -263,60 +275,212 @@ void socket_configure(void)
     }
 }
 
-void socket_write(char input_char)
+/* Store client in a free slot, growing the client table when it is full */
+static bool socket_client_add(int clientfd)
 {
-    if (!option.socket)
+    socket_client_t *table;
+    int i, size;
+
+    /* Client descriptors are multiplexed with select() */
+    if (clientfd >= FD_SETSIZE)
     {
-        return;
+        return false;
+    }
+
+    if (fcntl(clientfd, F_SETFL, fcntl(clientfd, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        return false;
+    }
+
+    for (i = 0; i != numclients; ++i)
+    {
+        if (clients[i].fd == -1)
+        {
+            break;
+        }
     }
 
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+    if (i == numclients)
+    {
+        size = MAX(numclients * 2, SOCKET_CLIENTS_INITIAL);
+        table = realloc(clients, sizeof(socket_client_t) * size);
+        if (table == NULL)
+        {
+            return false;
+        }
+        clients = table;
+        numclients = size;
+        for (int j = i; j != size; ++j)
+        {
+            clients[j].fd = -1;
+        }
+    }
+
+    clients[i].fd = clientfd;
+    clients[i].queue = g_string_new(NULL);
+
+    return true;
+}
+
+static void socket_client_close(socket_client_t *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    g_string_free(client->queue, TRUE);
+    client->queue = NULL;
+}
+
+static socket_client_t *socket_client_find(int clientfd)
+{
+    for (int i = 0; i != numclients; ++i)
     {
-        if (clientfds[i] != -1)
+        if (clients[i].fd == clientfd)
         {
+            return &clients[i];
+        }
+    }
+
+    return NULL;
+}
 
+/* Send as much queued data as client accepts without blocking. Returns false
+ * if client failed and was closed. */
+static bool socket_client_flush(socket_client_t *client)
+{
+    while (client->queue->len > 0)
+    {
 #if defined(SO_NOSIGPIPE) && !defined(MSG_NOSIGNAL)
-            if (send(clientfds[i], &input_char, 1, 0) <= 0)
+        ssize_t sent = send(client->fd, client->queue->str, client->queue->len, 0);
 #else
-            if (send(clientfds[i], &input_char, 1, MSG_NOSIGNAL) <= 0)
+        ssize_t sent = send(client->fd, client->queue->str, client->queue->len, MSG_NOSIGNAL);
 #endif
+        if (sent < 0)
+        {
+            if (errno == EINTR)
             {
-                tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
-                close(clientfds[i]);
-                clientfds[i] = -1;
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                break;
             }
+            tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
+            socket_client_close(client);
+            return false;
+        }
+        g_string_erase(client->queue, 0, sent);
+    }
+
+    return true;
+}
+
+/* Queue data for client and send what it accepts. Data is only ever sent in
+ * order and in full, unless the client is disconnected. Returns false if
+ * client was closed. */
+static bool socket_client_write(socket_client_t *client, const char *data, size_t len)
+{
+    g_string_append_len(client->queue, data, len);
+
+    if (!socket_client_flush(client))
+    {
+        return false;
+    }
+
+    if (client->queue->len > SOCKET_CLIENT_QUEUE_MAX)
+    {
+        tio_error_printf_silent("Disconnected socket client not reading data");
+        socket_client_close(client);
+        return false;
+    }
+
+    return true;
+}
+
+/* Send data to single client, e.g. from the connect handler */
+bool socket_write_client(int clientfd, const char *data, size_t len)
+{
+    socket_client_t *client = socket_client_find(clientfd);
+
+    if (client == NULL)
+    {
+        return false;
+    }
+
+    return socket_client_write(client, data, len);
+}
+
+void socket_write_data(const char *data, size_t len)
+{
+    if (!option.socket)
+    {
+        return;
+    }
+
+    for (int i = 0; i != numclients; ++i)
+    {
+        if (clients[i].fd != -1)
+        {
+            socket_client_write(&clients[i], data, len);
         }
     }
 }
 
-int socket_add_fds(fd_set *rdfs, bool connected)
+void socket_write(char input_char)
+{
+    socket_write_data(&input_char, 1);
+}
+
+void socket_set_connect_handler(void (*handler)(int fd))
+{
+    connect_handler = handler;
+}
+
+int socket_add_fds(fd_set *rdfs, fd_set *wrfs, bool connected)
 {
     if (!option.socket)
     {
         return 0;
     }
 
-    int numclients = 0, maxfd = 0;
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+    int maxfd = 0;
+    for (int i = 0; i != numclients; ++i)
     {
-        if (clientfds[i] != -1)
+        if (clients[i].fd != -1)
         {
             /* let clients block if they try to send while we're disconnected */
             if (connected)
             {
-                FD_SET(clientfds[i], rdfs);
-                maxfd = MAX(maxfd, clientfds[i]);
+                FD_SET(clients[i].fd, rdfs);
+                maxfd = MAX(maxfd, clients[i].fd);
+            }
+
+            /* wait for clients to accept queued data */
+            if (clients[i].queue->len > 0)
+            {
+                FD_SET(clients[i].fd, wrfs);
+                maxfd = MAX(maxfd, clients[i].fd);
             }
-            numclients++;
         }
     }
-    /* don't bother to accept clients if we're already full */
-    if (numclients != MAX_SOCKET_CLIENTS)
+    FD_SET(sockfd, rdfs);
+    maxfd = MAX(maxfd, sockfd);
+    return maxfd;
+}
+
+void socket_handle_output(fd_set *wrfs)
+{
+    if (!option.socket)
+    {
+        return;
+    }
+
+    for (int i = 0; i != numclients; ++i)
     {
-        FD_SET(sockfd, rdfs);
-        maxfd = MAX(maxfd, sockfd);
+        if ((clients[i].fd != -1) && FD_ISSET(clients[i].fd, wrfs))
+        {
+            socket_client_flush(&clients[i]);
+        }
     }
-    return maxfd;
 }
 
 bool socket_handle_input(fd_set *rdfs, char *output_char)
@@ -329,32 +493,37 @@ bool socket_handle_input(fd_set *rdfs, char *output_char)
     if (FD_ISSET(sockfd, rdfs))
     {
         int clientfd = accept(sockfd, NULL, NULL);
-        /* this loop should always succeed because we don't select on sockfd when full */
-        for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+        if (clientfd >= 0)
         {
-            if (clientfds[i] == -1)
+            if (!socket_client_add(clientfd))
             {
-                clientfds[i] = clientfd;
-                break;
+                tio_error_printf_silent("Failed to add socket client (too many clients)");
+                close(clientfd);
+            }
+            else if (connect_handler != NULL)
+            {
+                connect_handler(clientfd);
             }
         }
     }
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+    for (int i = 0; i != numclients; ++i)
     {
-        if (clientfds[i] != -1 && FD_ISSET(clientfds[i], rdfs))
+        if (clients[i].fd != -1 && FD_ISSET(clients[i].fd, rdfs))
         {
-            int status = read(clientfds[i], output_char, 1);
+            int status = read(clients[i].fd, output_char, 1);
             if (status == 0)
             {
-                close(clientfds[i]);
-                clientfds[i] = -1;
+                socket_client_close(&clients[i]);
                 continue;
             }
             if (status < 0)
             {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+                {
+                    continue;
+                }
                 tio_error_printf_silent("Failed to read from socket (%s)", strerror(errno));
-                close(clientfds[i]);
-                clientfds[i] = -1;
+                socket_client_close(&clients[i]);
                 continue;
             }
 
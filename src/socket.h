@@ -23,9 +23,14 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/select.h>
 
 void socket_configure(void);
 void socket_write(char input_char);
-int socket_add_fds(fd_set *fds, bool connected);
+void socket_write_data(const char *data, size_t len);
+bool socket_write_client(int fd, const char *data, size_t len);
+void socket_set_connect_handler(void (*handler)(int fd));
+int socket_add_fds(fd_set *rdfs, fd_set *wrfs, bool connected);
+void socket_handle_output(fd_set *wrfs);
 bool socket_handle_input(fd_set *fds, char *output_char);
@@ -73,27 +73,40 @@
 #include "misc.h"
 #include "script.h"
 #include "xymodem.h"
+#include "kermit.h"
 #include "fs.h"
 #include "readline.h"
+#include "hotplug.h"
 
 /* tty device listing configuration */
 
+/* Root of the sysfs and device node trees used for device discovery. May be
+ * set at build time to point discovery at a synthetic tree. */
+#ifndef DISCOVERY_ROOT
+#define DISCOVERY_ROOT ""
+#endif
+
 #if defined(__linux__)
-#define PATH_SERIAL_DEVICES "/dev"
-#define PATH_SERIAL_DEVICES_BY_ID "/dev/serial/by-id"
-#define PATH_SERIAL_DEVICES_BY_PATH "/dev/serial/by-path"
+#define PATH_SYSFS_TTY DISCOVERY_ROOT "/sys/class/tty"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev"
+#define PATH_SERIAL_DEVICES_BY_ID DISCOVERY_ROOT "/dev/serial/by-id"
+#define PATH_SERIAL_DEVICES_BY_PATH DISCOVERY_ROOT "/dev/serial/by-path"
 #elif defined(__FreeBSD__)
-#define PATH_SERIAL_DEVICES "/dev"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev"
 #elif defined(__APPLE__)
-#define PATH_SERIAL_DEVICES "/dev"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev"
 #elif defined(__CYGWIN__)
-#define PATH_SERIAL_DEVICES "/dev"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev"
 #elif defined(__HAIKU__)
-#define PATH_SERIAL_DEVICES "/dev/ports"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev/ports"
 #else
-#define PATH_SERIAL_DEVICES "/dev"
+#define PATH_SERIAL_DEVICES DISCOVERY_ROOT "/dev"
 #endif
 
+/* Device presence check intervals while waiting for device [ms] */
+#define DEVICE_WAIT_POLL_INTERVAL 1000
+#define DEVICE_WAIT_EVENT_INTERVAL 10000
+
 #ifndef CMSPAR
 #define CMSPAR   010000000000
 #endif
@@ -166,9 +179,17 @@ bool interactive_mode = true;
 char key_hit = 0xff;
 
 const char* device_name = NULL;
-GList *device_list = NULL;
+GPtrArray *device_list = NULL;
 static struct termios tio, tio_old, stdout_new, stdout_old, stdin_new, stdin_old;
 static unsigned long rx_total = 0, tx_total = 0;
+static struct
+{
+    unsigned long count;
+    double disconnect_time;
+    double appear_time;
+    double gap, gap_max;            // Time without connection [s]
+    double latency, latency_max;    // Time from device appearing to connected [s]
+} reconnect;
 static bool connected = false;
 static bool standard_baudrate = true;
 static void (*printchar)(char c);
@@ -756,7 +777,35 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
 
                             tio_printf("Ready to receiving file '%s'  ", line);
                             tio_printf("Press any key to abort transfer");
-                            ret = xymodem_send(device_fd, line, XMODEM_CRC);
+                            ret = xymodem_receive(device_fd, line, XMODEM_CRC);
+                            tio_printf("%s", ret < 0 ? "Aborted" : "Done");
+                        }
+                        break;
+
+                    case KEY_3:
+                        tio_printf("Send file with Kermit");
+                        tio_printf_raw("Enter file name: ");
+                        if (tio_readln())
+                        {
+                            int ret;
+
+                            tio_printf("Sending file '%s'  ", line);
+                            tio_printf("Press any key to abort transfer");
+                            ret = kermit_send(device_fd, line);
+                            tio_printf("%s", ret < 0 ? "Aborted" : "Done");
+                        }
+                        break;
+
+                    case KEY_4:
+                        tio_printf("Receive file with Kermit");
+                        tio_printf_raw("Enter file name: ");
+                        if (tio_readln())
+                        {
+                            int ret;
+
+                            tio_printf("Ready to receiving file '%s'  ", line);
+                            tio_printf("Press any key to abort transfer");
+                            ret = kermit_receive(device_fd, line);
                             tio_printf("%s", ret < 0 ? "Aborted" : "Done");
                         }
                         break;
@@ -876,7 +925,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 tio_printf(" ctrl-%c s       Show statistics", option.prefix_key);
                 tio_printf(" ctrl-%c t       Toggle line timestamp mode", option.prefix_key);
                 tio_printf(" ctrl-%c v       Show version", option.prefix_key);
-                tio_printf(" ctrl-%c x       Send/Receive file via Xmodem", option.prefix_key);
+                tio_printf(" ctrl-%c x       Send/Receive file via Xmodem or Kermit", option.prefix_key);
                 tio_printf(" ctrl-%c y       Send file via Ymodem", option.prefix_key);
                 tio_printf(" ctrl-%c ctrl-%c  Send ctrl-%c character", option.prefix_key, option.prefix_key, option.prefix_key);
                 break;
@@ -1077,6 +1126,13 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 tio_printf("Statistics:");
                 tio_printf(" Sent %lu bytes", tx_total);
                 tio_printf(" Received %lu bytes", rx_total);
+                if (reconnect.count > 0)
+                {
+                    tio_printf(" Reconnected %lu times, %.3f s gap (%.3f s max), %.3f ms latency (%.3f ms max)",
+                               reconnect.count, reconnect.gap, reconnect.gap_max,
+                               reconnect.latency * 1000, reconnect.latency_max * 1000);
+                }
+                script_hooks_statistics_print();
                 break;
 
             case KEY_T:
@@ -1115,10 +1171,12 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 break;
 
             case KEY_X:
-                tio_printf("Please enter which X modem protocol to use:");
+                tio_printf("Please enter which file transfer protocol to use:");
                 tio_printf(" (0) XMODEM-1K send");
                 tio_printf(" (1) XMODEM-CRC send");
                 tio_printf(" (2) XMODEM-CRC receive");
+                tio_printf(" (3) Kermit send");
+                tio_printf(" (4) Kermit receive");
                 // Process next input character as sub command
                 sub_command = SUBCOMMAND_XMODEM;
                 break;
@@ -1456,13 +1514,15 @@ static bool is_serial_device(const char *format, ...)
 
     if (fstat(fd, &st) == -1)
     {
-        return false;
+        status = false;
+        goto error;
     }
 
     // Make sure it is a character device
     if ((st.st_mode & S_IFMT) != S_IFCHR)
     {
-        return false;
+        status = false;
+        goto error;
     }
 
     // Make sure it is a tty
@@ -1489,62 +1549,55 @@ error:
     return status;
 }
 
-static void list_serial_devices_by_id(void)
+#if defined(PATH_SERIAL_DEVICES_BY_ID) || defined(PATH_SERIAL_DEVICES_BY_PATH)
+
+/* List symbolic links in directory which point to a found serial device.
+ * Links are matched by device number so devices are not probed again. */
+static void list_serial_device_links(const char *title, const char *path)
 {
-#ifdef PATH_SERIAL_DEVICES_BY_ID
-    DIR *d = opendir(PATH_SERIAL_DEVICES_BY_ID);
+    char link_path[PATH_MAX];
+    struct stat st;
+
+    DIR *d = opendir(path);
     if (d)
     {
         struct dirent *dir;
 
-        printf("By-id\n");
+        printf("%s\n", title);
         printf("--------------------------------------------------------------------------------\n");
 
         while ((dir = readdir(d)) != NULL)
         {
             if ((strcmp(dir->d_name, ".")) && (strcmp(dir->d_name, "..")))
             {
-                if (is_serial_device("%s/%s", PATH_SERIAL_DEVICES_BY_ID, dir->d_name))
+                snprintf(link_path, sizeof(link_path), "%s/%s", path, dir->d_name);
+                if ((stat(link_path, &st) != 0) || (!S_ISCHR(st.st_mode)))
                 {
-                    printf("%s/%s\n", PATH_SERIAL_DEVICES_BY_ID, dir->d_name);
+                    continue;
                 }
-            }
-        }
-        closedir(d);
-    }
-#endif
-}
-
-static void list_serial_devices_by_path(void)
-{
-#ifdef PATH_SERIAL_DEVICES_BY_PATH
-    DIR *d = opendir(PATH_SERIAL_DEVICES_BY_PATH);
-    if (d)
-    {
-        struct dirent *dir;
 
-        printf("\nBy-path\n");
-        printf("--------------------------------------------------------------------------------\n");
-
-        while ((dir = readdir(d)) != NULL)
-        {
-            if ((strcmp(dir->d_name, ".")) && (strcmp(dir->d_name, "..")))
-            {
-                if (is_serial_device("%s/%s", PATH_SERIAL_DEVICES_BY_PATH, dir->d_name))
+                for (guint i = 0; i < device_list->len; i++)
                 {
-                    printf("%s/%s\n", PATH_SERIAL_DEVICES_BY_PATH, dir->d_name);
+                    device_t *device = g_ptr_array_index(device_list, i);
+
+                    if (device->rdev == st.st_rdev)
+                    {
+                        printf("%s\n", link_path);
+                        break;
+                    }
                 }
             }
         }
         closedir(d);
     }
-#endif
 }
 
+#endif
+
 static gint compare_uptime(gconstpointer a, gconstpointer b)
 {
-    device_t *device_a = (device_t *) a;
-    device_t *device_b = (device_t *) b;
+    device_t *device_a = *(device_t **) a;
+    device_t *device_b = *(device_t **) b;
 
     // Make sure we end up with device with smallest uptime last in list
     if (device_a->uptime > device_b->uptime)
@@ -1561,10 +1614,10 @@ static gint compare_uptime(gconstpointer a, gconstpointer b)
 const char* get_serial_port_type(const char* port_name)
 {
     int fd;
-    static struct serial_struct serial_info;
+    struct serial_struct serial_info;
 
     // Open the serial port
-    fd = open(port_name, O_RDWR);
+    fd = open(port_name, O_RDWR | O_NONBLOCK | O_NOCTTY);
     if (fd == -1)
     {
         return "";
@@ -1637,30 +1690,31 @@ const char* get_serial_port_type(const char* port_name)
 
 #endif
 
-static void search_reset(void)
+static void device_free(gpointer data)
 {
-    GList *iter;
+    device_t *device = (device_t *) data;
 
-    if (g_list_length(device_list) == 0)
-    {
-        return;
-    }
+    g_free(device->tid);
+    g_free(device->path);
+    g_free(device->driver);
+    g_free(device->description);
+    g_free(device);
+}
 
-    // Free data of all list elements
-    for (iter = device_list; iter != NULL; iter = g_list_next(iter))
+static void search_reset(void)
+{
+    if (device_list == NULL)
     {
-        device_t *device = (device_t *) iter->data;
-        g_free(device->tid);
-        g_free(device->path);
-        g_free(device->driver);
-        g_free(device->description);
+        device_list = g_ptr_array_new();
     }
 
-    // Free all list elements
-    g_list_free_full(device_list, g_free);
+#if !defined(__linux__)
+    // Device list owns devices, on Linux they are owned by the inventory
+    g_ptr_array_foreach(device_list, (GFunc) device_free, NULL);
+#endif
 
     // Indicate an empty list
-    device_list = NULL;
+    g_ptr_array_set_size(device_list, 0);
 
     // Reset max device name length
     listing_device_name_length_max = 0;
@@ -1668,269 +1722,750 @@ static void search_reset(void)
 
 #if defined(__linux__)
 
-GList *tty_search_for_serial_devices(void)
+/* Inventory of ttys in /sys/class/tty keyed by sysfs name. Entries are reused
+ * as long as the corresponding /dev node is unchanged so only added or
+ * replaced devices are probed.
+ *
+ * Probing opens the device which may block for a long time on some drivers,
+ * so it is done by a small pool of worker threads. A search waits at most
+ * PROBE_TIMEOUT for its probes, devices with slower probes are left out until
+ * a later search finds their probe completed. Probes completing outside a
+ * search are signalled on probe_pipe so a monitor can search again at once.
+ * Workers blocked in a probe for longer than PROBE_TIMEOUT are replaced, up to
+ * PROBE_WORKERS_STUCK of them, so hung devices do not hold up other probes. */
+#define PROBE_WORKERS 8
+#define PROBE_WORKERS_STUCK 16 // Max. number of replaced stuck workers
+#define PROBE_TIMEOUT 1000 // Max. time a search waits for device probes [ms]
+
+typedef struct
+{
+    char *name;
+    device_t *device;   // NULL if not a serial device
+    unsigned int generation;
+    double started;     // Time probe started, 0 if queued
+    bool done;
+    bool abandoned;     // Owner gone, worker frees job when done
+} probe_job_t;
+
+typedef struct
+{
+    ino_t ino;
+    struct timespec ctime;
+    probe_job_t *job;   // Probe in progress
+    device_t *device;   // NULL if not a serial device or excluded
+    unsigned int generation;
+} inventory_entry_t;
+
+static GHashTable *inventory = NULL;
+static unsigned int inventory_generation = 0;
+
+static pthread_mutex_t probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_cond = PTHREAD_COND_INITIALIZER;
+static GQueue probe_queue = G_QUEUE_INIT;
+static GQueue probe_running = G_QUEUE_INIT;
+static int probe_workers = 0;
+static int probe_pipe[2] = { -1, -1 };
+static int probe_workers_idle = 0;
+
+static device_t *device_probe(const char *name)
 {
-    DIR *dir;
     char path[PATH_MAX] = {};
-    char device_path[PATH_MAX] = {};
     char driver_path[PATH_MAX] = {};
-    double current_time, creation_time;
+    struct stat st;
     ssize_t length;
 
-    search_reset();
-
-    // Open the sysfs directory for the tty subsystem
-    dir = opendir("/sys/class/tty");
-    if (!dir)
+    // Skip non serial devices
+    if (is_serial_device(PATH_SERIAL_DEVICES "/%s", name) == false)
     {
         return NULL;
     }
 
-    current_time = get_current_time();
+    // Construct the path to the device's device symlink
+    snprintf(path, sizeof(path), PATH_SYSFS_TTY "/%s/device", name);
 
-    // Iterate through each device in the subsystem directory
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
+    // Resolve the device symlink to get the device path in /sys/devices
+    // Example symlinks:
+    //  /sys/class/tty/ttyUSB0/device -> ../../../ttyUSB0
+    //  /sys/class/tty/ttyACM0/device -> ../../../3-6.4:1.2
+    // Example devices_path:
+    //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.3/3-6.3:1.0/ttyUSB0"
+    //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.4/3-6.4:1.2"
+    char *devices_path = realpath(path, NULL);
+    if (devices_path == NULL)
     {
-        // Skip . and .. entries
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-        {
-            continue;
-        }
-
-        // Skip non serial devices
-        if (is_serial_device("/dev/%s", entry->d_name) == false)
-        {
-            continue;
-        }
+        return NULL;
+    }
 
-        // Construct the path to the device's device symlink
-        snprintf(path, sizeof(path), "/sys/class/tty/%s/device", entry->d_name);
+    // Remove last part if it contains device short name (e.g ttyUSB0)
+    // Example resulting devices_path:
+    //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.3/3-6.3:1.0"
+    //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.4/3-6.4:1.2"
+    char *last_part = strrchr(devices_path, '/');
+    last_part++;
+    if (strcmp(last_part, name) == 0)
+    {
+        // Remove last part (string after last '/')
+        char *slash = strrchr(devices_path, '/');
+        int index = (int) (slash - devices_path);
+        devices_path[index] = '\0';
+    }
 
-        // Read the device symlink to get the device path
-        // Example symlinks:
-        //  /sys/class/tty/ttyUSB0/device -> ../../../ttyUSB0
-        //  /sys/class/tty/ttyACM0/device -> ../../../3-6.4:1.2
-        length = readlink(path, device_path, sizeof(device_path) - 1);
-        if (length == -1)
-        {
-            continue;
-        }
+    // Hash remaining string, relative to discovery root, to get unique topology ID
+    const char *topology = devices_path;
+    if (strncmp(topology, DISCOVERY_ROOT, strlen(DISCOVERY_ROOT)) == 0)
+    {
+        topology += strlen(DISCOVERY_ROOT);
+    }
+    unsigned long hash = djb2_hash((const unsigned char *)topology);
+    char tid[5];
+    base62_encode(hash, tid);
+    free(devices_path);
 
-        // Null-terminate the string
-        device_path[length] = '\0';
+    // Construct the path to the device's driver symlink
+    snprintf(path, sizeof(path), PATH_SYSFS_TTY "/%s/device/driver", name);
 
-        // Extract last part of device path (string after last '/')
-        // Example resulting device_name:
-        //  "ttyUSB0"
-        //  "3-6.4:1.2"
-        char *last_part = strrchr(device_path, '/');
-        last_part++; // Move past the '/'
+    // Read the symlink to get the driver's path
+    length = readlink(path, driver_path, sizeof(driver_path) - 1);
+    if (length == -1)
+    {
+        return NULL;
+    }
 
-        // Find that part in /sys/devices and return first result string
-        // Example devices_path:
-        //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.3/3-6.3:1.0/ttyUSB0"
-        //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.4/3-6.4:1.2"
-        char *devices_path = fs_search_directory("/sys/devices", last_part);
-        if (devices_path == NULL)
-        {
-            continue;
-        }
+    // Null-terminate the string
+    driver_path[length] = '\0';
 
-        // Remove last part if it contains device short name (e.g ttyUSB0)
-        // Example resulting devices_path:
-        //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.3/3-6.3:1.0"
-        //  "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-6/3-6.4/3-6.4:1.2"
-        last_part = strrchr(devices_path, '/');
-        last_part++;
-        if (strcmp(last_part, entry->d_name) == 0)
-        {
-            // Remove last part (string after last '/')
-            char *slash = strrchr(devices_path, '/');
-            int index = (int) (slash - devices_path);
-            devices_path[index] = '\0';
-        }
+    // Extract the driver name from the path
+    char *driver = strrchr(driver_path, '/');
+    if (driver == NULL)
+    {
+        return NULL;
+    }
+    driver++; // Move past the last '/'
 
-        // Hash remaining string to get unique topology ID
-        unsigned long hash = djb2_hash((const unsigned char *)devices_path);
-        char tid[5];
-        base62_encode(hash, tid);
-        free(devices_path);
+    // Construct the path to the TTY device file
+    snprintf(path, sizeof(path), PATH_SERIAL_DEVICES "/%s", name);
 
-        // Construct the path to the device's driver symlink
-        snprintf(path, sizeof(path), "/sys/class/tty/%s/device/driver", entry->d_name);
+    // Read sysfs files to get best possible description
+    char description[50] = {};
+    length = fs_read_file_stripped(description, sizeof(description), PATH_SYSFS_TTY "/%s/device/../product", name);
+    if (length == -1)
+    {
+        length = fs_read_file_stripped(description, sizeof(description), PATH_SYSFS_TTY "/%s/device/../../product", name);
+    }
+    if (length == -1)
+    {
+        length = fs_read_file_stripped(description, sizeof(description), PATH_SYSFS_TTY "/%s/device/interface", name);
+    }
+    if (length == -1)
+    {
+        length = fs_read_file_stripped(description, sizeof(description), PATH_SYSFS_TTY "/%s/device/../interface", name);
+    }
+    if (length == -1)
+    {
+        snprintf(description, sizeof(description), "%s", get_serial_port_type(path));
+    }
 
-        // Read the symlink to get the driver's path
-        length = readlink(path, driver_path, sizeof(driver_path) - 1);
-        if (length == -1)
-        {
-            continue;
-        }
+    // Allocate new device item
+    device_t *device = g_new0(device_t, 1);
 
-        // Null-terminate the string
-        driver_path[length] = '\0';
+    // Fill in device information
+    device->path = g_strdup(path);
+    device->tid = g_strdup(tid);
+    device->driver = g_strdup(driver);
+    device->description = g_strdup(description);
+    device->creation_time = fs_get_creation_time(path);
+    if (stat(path, &st) == 0)
+    {
+        device->rdev = st.st_rdev;
+    }
 
-        // Extract the driver name from the path
-        char *driver = strrchr(driver_path, '/');
-        if (driver == NULL)
-        {
-            continue;
-        }
-        driver++; // Move past the last '/'
+    return device;
+}
 
-        // Construct the path to the TTY device file
-        snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+static void probe_job_free(probe_job_t *job)
+{
+    if (job->device != NULL)
+    {
+        device_free(job->device);
+    }
+    g_free(job->name);
+    g_free(job);
+}
 
-        // Calculate uptime
-        creation_time = fs_get_creation_time(path);
-        double uptime = current_time - creation_time;
+static void *probe_worker(void *arg)
+{
+    UNUSED(arg);
 
-        // Read sysfs files to get best possible description
-        char description[50] = {};
-        length = fs_read_file_stripped(description, sizeof(description), "/sys/class/tty/%s/device/../product", entry->d_name);
-        if (length == -1)
-        {
-            length = fs_read_file_stripped(description, sizeof(description), "/sys/class/tty/%s/device/../../product", entry->d_name);
-        }
-        if (length == -1)
-        {
-            length = fs_read_file_stripped(description, sizeof(description), "/sys/class/tty/%s/device/interface", entry->d_name);
-        }
-        if (length == -1)
-        {
-            length = fs_read_file_stripped(description, sizeof(description), "/sys/class/tty/%s/device/../interface", entry->d_name);
-        }
-        if (length == -1)
-        {
-            snprintf(description, sizeof(description), "%s", get_serial_port_type(path));
-        }
+    pthread_mutex_lock(&probe_mutex);
 
-        // Do not add devices excluded by exclude patterns
-        if (match_patterns(path, option.exclude_devices))
-        {
-            continue;
-        }
-        if (match_patterns(driver, option.exclude_drivers))
-        {
-            continue;
-        }
-        if (match_patterns(tid, option.exclude_tids))
-        {
-            continue;
-        }
+    // Counted as idle from creation on, see probe_workers_spawn()
+    probe_workers_idle--;
 
-        // Allocate new device item for device list
-        device_t *device = g_new0(device_t, 1);
-        if (device == NULL)
+    while (true)
+    {
+        probe_job_t *job = g_queue_pop_head(&probe_queue);
+        if (job == NULL)
         {
+            probe_workers_idle++;
+            pthread_cond_wait(&probe_cond, &probe_mutex);
+            probe_workers_idle--;
             continue;
         }
 
-        // Fill in device information
-        device->path = g_strdup(path);
-        device->tid = g_strdup(tid);
-        device->uptime = uptime;
-        device->driver = g_strdup(driver);
-        device->description = g_strdup(description);
+        job->started = get_current_time();
+        g_queue_push_tail(&probe_running, job);
 
-        // Add device information to device list
-        device_list = g_list_append(device_list, device);
+        pthread_mutex_unlock(&probe_mutex);
+        device_t *device = device_probe(job->name);
+        pthread_mutex_lock(&probe_mutex);
 
-        // Update length of longest device name string
-        if (strlen(device->path) > listing_device_name_length_max)
+        g_queue_remove(&probe_running, job);
+        job->device = device;
+        job->done = true;
+        if (job->abandoned)
         {
-            listing_device_name_length_max = strlen(device->path);
+            probe_job_free(job);
+        }
+        else if (probe_pipe[1] != -1)
+        {
+            // Failure with a full pipe is fine, a search is due anyway
+            char c = 0;
+            ssize_t ret = write(probe_pipe[1], &c, 1);
+            UNUSED(ret);
         }
+        pthread_cond_broadcast(&probe_cond);
     }
 
-    if (g_list_length(device_list) == 0)
+    return NULL;
+}
+
+/* Create pipe signalled by workers when a probe completes */
+static void probe_pipe_create(void)
+{
+    if (pipe(probe_pipe) == -1)
     {
-        // Return NULL if no serial devices found
-        return NULL;
+        probe_pipe[0] = probe_pipe[1] = -1;
+        return;
     }
 
-    // Sort device list device with respect to uptime
-    device_list = g_list_sort(device_list, compare_uptime);
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(probe_pipe[i], F_SETFL, fcntl(probe_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(probe_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+}
 
-    closedir(dir);
+/* Discard pending probe completion signals. Must be called with probe_mutex
+ * held. */
+static void probe_pipe_drain(void)
+{
+    char buffer[64];
 
-    return device_list;
+    if (probe_pipe[0] != -1)
+    {
+        while (read(probe_pipe[0], buffer, sizeof(buffer)) > 0)
+        {
+        }
+    }
 }
 
-#elif defined(__APPLE__) || defined(__MACH__)
+/* File descriptor readable when probes have completed since the last search,
+ * -1 if not available */
+static int probe_fd(void)
+{
+    return probe_pipe[0];
+}
 
-char *getPropertyString(io_object_t device, CFStringRef property)
+/* Add workers for queued probes unless idle ones can take them. Workers stuck
+ * in a probe past PROBE_TIMEOUT do not count towards PROBE_WORKERS. Must be
+ * called with probe_mutex held. */
+static void probe_workers_spawn(void)
 {
-    /* Validate inputs */
-    if (device == IO_OBJECT_NULL || property == NULL)
-    {
-        return NULL;
-    }
+    double now = get_current_time();
+    int stuck = 0;
 
-    /* Attempt to get property */
-    CFTypeRef valueRef = IORegistryEntryCreateCFProperty(
-        device, property, kCFAllocatorDefault, 0);
-    if (!valueRef)
+    for (GList *iter = probe_running.head; iter != NULL; iter = iter->next)
     {
-        return NULL;
-    }
+        probe_job_t *job = iter->data;
 
-    /* Ensure it's a CFString */
-    if (CFGetTypeID(valueRef) != CFStringGetTypeID())
+        if ((now - job->started) * 1000 > PROBE_TIMEOUT)
+        {
+            stuck++;
+        }
+    }
+    if (stuck > PROBE_WORKERS_STUCK)
     {
-        CFRelease(valueRef);
-        return NULL;
+        stuck = PROBE_WORKERS_STUCK;
     }
 
-    /* Convert to C string */
-    CFIndex length = CFStringGetLength(valueRef);
-    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1;
-    char *result = malloc(maxSize);
-
-    if (!result)
+    while ((probe_workers_idle < (int) g_queue_get_length(&probe_queue)) &&
+           (probe_workers < PROBE_WORKERS + stuck))
     {
-        CFRelease(valueRef);
-        return NULL;
+        pthread_t worker;
+
+        if (pthread_create(&worker, NULL, probe_worker, NULL) != 0)
+        {
+            break;
+        }
+        pthread_detach(worker);
+        probe_workers++;
+        probe_workers_idle++;
     }
+}
 
-    bool converted = CFStringGetCString(
-        (CFStringRef)valueRef,
-        result,
-        maxSize,
-        kCFStringEncodingUTF8
-    );
+/* Queue probe of tty. Must be called with probe_mutex held. */
+static probe_job_t *probe_submit(const char *name)
+{
+    probe_job_t *job = g_new0(probe_job_t, 1);
+    job->name = g_strdup(name);
+    job->generation = inventory_generation;
 
-    CFRelease(valueRef);
+    g_queue_push_tail(&probe_queue, job);
+    probe_workers_spawn();
 
-    if (!converted)
-    {
-        free(result);
-        return NULL;
-    }
+    pthread_cond_broadcast(&probe_cond);
 
-    return result;
+    return job;
 }
 
-char *getDeviceLocation(io_object_t device)
+/* Collect result of finished probe. Must be called with probe_mutex held. */
+static void probe_collect(inventory_entry_t *entry)
 {
-    /* Validate device */
-    if (device == IO_OBJECT_NULL)
+    if ((entry->job == NULL) || (!entry->job->done))
     {
-        return strdup("Invalid Device");
+        return;
     }
 
-    /* Attempt to get location */
-    io_string_t location = {0};
-    kern_return_t result = IORegistryEntryGetLocationInPlane(
-        device, kIOServicePlane, location);
+    device_t *device = entry->job->device;
+    entry->job->device = NULL;
+    probe_job_free(entry->job);
+    entry->job = NULL;
 
-    if (result != KERN_SUCCESS)
+    // Do not add devices excluded by exclude patterns
+    if ((device != NULL) &&
+        (match_patterns(device->path, option.exclude_devices) ||
+         match_patterns(device->driver, option.exclude_drivers) ||
+         match_patterns(device->tid, option.exclude_tids)))
     {
-        return strdup("Unknown Location");
+        device_free(device);
+        device = NULL;
     }
 
-    /* Safely copy location */
-    size_t len = strnlen(location, sizeof(io_string_t));
+    entry->device = device;
+}
+
+static void inventory_entry_free(gpointer data)
+{
+    inventory_entry_t *entry = (inventory_entry_t *) data;
+
+    if (entry->job != NULL)
+    {
+        pthread_mutex_lock(&probe_mutex);
+        if (entry->job->done)
+        {
+            probe_job_free(entry->job);
+        }
+        else if (!g_queue_remove(&probe_queue, entry->job))
+        {
+            // Probe in progress, leave job to worker
+            entry->job->abandoned = true;
+        }
+        else
+        {
+            probe_job_free(entry->job);
+        }
+        pthread_mutex_unlock(&probe_mutex);
+    }
+    if (entry->device != NULL)
+    {
+        device_free(entry->device);
+    }
+    g_free(entry);
+}
+
+static gboolean inventory_entry_stale(gpointer key, gpointer value, gpointer user_data)
+{
+    inventory_entry_t *entry = (inventory_entry_t *) value;
+    UNUSED(key);
+    UNUSED(user_data);
+
+    return entry->generation != inventory_generation;
+}
+
+GPtrArray *tty_search_for_serial_devices(void)
+{
+    DIR *dir;
+    char path[PATH_MAX] = {};
+    double current_time;
+    struct stat st;
+    GHashTableIter iter;
+    gpointer value;
+
+    search_reset();
+
+    if (inventory == NULL)
+    {
+        inventory = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, inventory_entry_free);
+        probe_pipe_create();
+    }
+
+    // Open the sysfs directory for the tty subsystem
+    dir = opendir(PATH_SYSFS_TTY);
+    if (!dir)
+    {
+        return NULL;
+    }
+
+    inventory_generation++;
+
+    // Iterate through each device in the subsystem directory
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        // Skip . and .. entries
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        // Identify device node, a replaced node gets a new inode or ctime
+        snprintf(path, sizeof(path), PATH_SERIAL_DEVICES "/%s", entry->d_name);
+        if (stat(path, &st) == -1)
+        {
+            memset(&st, 0, sizeof(st));
+        }
+
+        inventory_entry_t *item = g_hash_table_lookup(inventory, entry->d_name);
+        if ((item == NULL) ||
+            (item->ino != st.st_ino) ||
+            (item->ctime.tv_sec != st.st_ctim.tv_sec) ||
+            (item->ctime.tv_nsec != st.st_ctim.tv_nsec))
+        {
+            // New or replaced tty -> probe it
+            item = g_new0(inventory_entry_t, 1);
+            item->ino = st.st_ino;
+            item->ctime = st.st_ctim;
+            if (st.st_ino != 0)
+            {
+                pthread_mutex_lock(&probe_mutex);
+                item->job = probe_submit(entry->d_name);
+                pthread_mutex_unlock(&probe_mutex);
+            }
+            g_hash_table_replace(inventory, g_strdup(entry->d_name), item);
+        }
+        item->generation = inventory_generation;
+    }
+
+    closedir(dir);
+
+    // Forget ttys which have been removed
+    g_hash_table_foreach_remove(inventory, inventory_entry_stale, NULL);
+
+    // Replace workers stuck since previous searches
+    pthread_mutex_lock(&probe_mutex);
+    probe_workers_spawn();
+    pthread_mutex_unlock(&probe_mutex);
+
+    // Wait for probes submitted by this search to complete
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += PROBE_TIMEOUT / 1000;
+    deadline.tv_nsec += (PROBE_TIMEOUT % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&probe_mutex);
+    bool timed_out = false;
+    while (true)
+    {
+        bool pending = false;
+
+        g_hash_table_iter_init(&iter, inventory);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            inventory_entry_t *item = (inventory_entry_t *) value;
+
+            probe_collect(item);
+            if ((item->job != NULL) && (item->job->generation == inventory_generation))
+            {
+                pending = true;
+            }
+        }
+
+        // Collect once more after a timeout to not miss a probe completed meanwhile
+        if (!pending || timed_out)
+        {
+            break;
+        }
+        timed_out = (pthread_cond_timedwait(&probe_cond, &probe_mutex, &deadline) == ETIMEDOUT);
+    }
+
+    // Let probes queued behind stuck ones complete for a later search
+    if (timed_out)
+    {
+        probe_workers_spawn();
+    }
+
+    // Completions so far are collected, only later ones need another search
+    probe_pipe_drain();
+    pthread_mutex_unlock(&probe_mutex);
+
+    current_time = get_current_time();
+
+    g_hash_table_iter_init(&iter, inventory);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        device_t *device = ((inventory_entry_t *) value)->device;
+        if (device == NULL)
+        {
+            continue;
+        }
+
+        // Calculate uptime
+        device->uptime = current_time - device->creation_time;
+
+        // Add device information to device list
+        g_ptr_array_add(device_list, device);
+
+        // Update length of longest device name string
+        if (strlen(device->path) > listing_device_name_length_max)
+        {
+            listing_device_name_length_max = strlen(device->path);
+        }
+    }
+
+    if (device_list->len == 0)
+    {
+        // Return NULL if no serial devices found
+        return NULL;
+    }
+
+    // Sort device list device with respect to uptime
+    g_ptr_array_sort(device_list, compare_uptime);
+
+    return device_list;
+}
+
+/* Topology ID index. Maps topology IDs of the devices found by the last full
+ * search to their device node so sessions started with a topology ID target
+ * can skip the search. An entry is only trusted while the device node and its
+ * sysfs entry are unchanged. Stored in $XDG_RUNTIME_DIR/tio/tid-index with one
+ * entry per line:
+ *   <tid> <device path> <driver> <node inode> <node ctime s> <node ctime ns> <sysfs inode>
+ */
+static char *tid_index_path(void)
+{
+    char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL)
+    {
+        return NULL;
+    }
+
+    return g_strdup_printf("%s/tio/tid-index", runtime_dir);
+}
+
+static bool tid_index_stat(const char *path, struct stat *node, struct stat *sysfs)
+{
+    const char *name = strrchr(path, '/');
+
+    if ((name == NULL) || (stat(path, node) == -1))
+    {
+        return false;
+    }
+
+    char sysfs_path[PATH_MAX];
+    snprintf(sysfs_path, sizeof(sysfs_path), PATH_SYSFS_TTY "%s", name);
+
+    return stat(sysfs_path, sysfs) == 0;
+}
+
+static const char *tid_index_lookup(const char *tid)
+{
+    static char path[PATH_MAX];
+    char buffer[PATH_MAX + 128];
+    char entry_tid[TOPOLOGY_ID_SIZE + 1];
+    char driver[64];
+    unsigned long long node_ino, sysfs_ino;
+    long long ctime_sec;
+    long ctime_nsec;
+    struct stat node, sysfs;
+    bool found = false;
+
+    char *index_path = tid_index_path();
+    if (index_path == NULL)
+    {
+        return NULL;
+    }
+
+    FILE *file = fopen(index_path, "r");
+    g_free(index_path);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    while (fgets(buffer, sizeof(buffer), file) != NULL)
+    {
+        if (sscanf(buffer, "%4s %4095s %63s %llu %lld %ld %llu", entry_tid, path, driver,
+                   &node_ino, &ctime_sec, &ctime_nsec, &sysfs_ino) != 7)
+        {
+            continue;
+        }
+
+        if (strcmp(entry_tid, tid) == 0)
+        {
+            found = true;
+            break;
+        }
+    }
+    fclose(file);
+
+    if (!found)
+    {
+        return NULL;
+    }
+
+    // Validate entry against current device node and sysfs entry
+    if ((!tid_index_stat(path, &node, &sysfs)) ||
+        (node.st_ino != node_ino) ||
+        (node.st_ctim.tv_sec != ctime_sec) ||
+        (node.st_ctim.tv_nsec != ctime_nsec) ||
+        (sysfs.st_ino != sysfs_ino))
+    {
+        return NULL;
+    }
+
+    // Respect exclude patterns of this session
+    if (match_patterns(path, option.exclude_devices) ||
+        match_patterns(driver, option.exclude_drivers) ||
+        match_patterns(tid, option.exclude_tids))
+    {
+        return NULL;
+    }
+
+    return path;
+}
+
+static void tid_index_store(void)
+{
+    struct stat node, sysfs;
+
+    char *index_path = tid_index_path();
+    if (index_path == NULL)
+    {
+        return;
+    }
+
+    // Write to temporary file and rename so concurrent readers never see a partial index
+    char *dir = g_path_get_dirname(index_path);
+    char *tmp_path = g_strdup_printf("%s.%d", index_path, (int) getpid());
+    mkdir(dir, 0700);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (file != NULL)
+    {
+        for (guint i = 0; i < device_list->len; i++)
+        {
+            device_t *device = g_ptr_array_index(device_list, i);
+
+            if (!tid_index_stat(device->path, &node, &sysfs))
+            {
+                continue;
+            }
+
+            fprintf(file, "%s %s %s %llu %lld %ld %llu\n", device->tid, device->path, device->driver,
+                    (unsigned long long) node.st_ino, (long long) node.st_ctim.tv_sec,
+                    (long) node.st_ctim.tv_nsec, (unsigned long long) sysfs.st_ino);
+        }
+
+        if ((fclose(file) != 0) || (rename(tmp_path, index_path) != 0))
+        {
+            unlink(tmp_path);
+        }
+    }
+
+    g_free(tmp_path);
+    g_free(dir);
+    g_free(index_path);
+}
+
+#elif defined(__APPLE__) || defined(__MACH__)
+
+char *getPropertyString(io_object_t device, CFStringRef property)
+{
+    /* Validate inputs */
+    if (device == IO_OBJECT_NULL || property == NULL)
+    {
+        return NULL;
+    }
+
+    /* Attempt to get property */
+    CFTypeRef valueRef = IORegistryEntryCreateCFProperty(
+        device, property, kCFAllocatorDefault, 0);
+    if (!valueRef)
+    {
+        return NULL;
+    }
+
+    /* Ensure it's a CFString */
+    if (CFGetTypeID(valueRef) != CFStringGetTypeID())
+    {
+        CFRelease(valueRef);
+        return NULL;
+    }
+
+    /* Convert to C string */
+    CFIndex length = CFStringGetLength(valueRef);
+    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1;
+    char *result = malloc(maxSize);
+
+    if (!result)
+    {
+        CFRelease(valueRef);
+        return NULL;
+    }
+
+    bool converted = CFStringGetCString(
+        (CFStringRef)valueRef,
+        result,
+        maxSize,
+        kCFStringEncodingUTF8
+    );
+
+    CFRelease(valueRef);
+
+    if (!converted)
+    {
+        free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+char *getDeviceLocation(io_object_t device)
+{
+    /* Validate device */
+    if (device == IO_OBJECT_NULL)
+    {
+        return strdup("Invalid Device");
+    }
+
+    /* Attempt to get location */
+    io_string_t location = {0};
+    kern_return_t result = IORegistryEntryGetLocationInPlane(
+        device, kIOServicePlane, location);
+
+    if (result != KERN_SUCCESS)
+    {
+        return strdup("Unknown Location");
+    }
+
+    /* Safely copy location */
+    size_t len = strnlen(location, sizeof(io_string_t));
     char *trimmed_location = calloc(1, len + 1);
 
     if (!trimmed_location)
@@ -1943,7 +2478,7 @@ char *getDeviceLocation(io_object_t device)
 }
 
 // for __APPLE__
-GList *tty_search_for_serial_devices(void)
+GPtrArray *tty_search_for_serial_devices(void)
 {
     search_reset();
     io_iterator_t iter = IO_OBJECT_NULL;
@@ -2053,7 +2588,7 @@ GList *tty_search_for_serial_devices(void)
         };
 
         /* Add to device list */
-        device_list = g_list_append(device_list, device_info);
+        g_ptr_array_add(device_list, device_info);
 
         /* Clean up */
         free(locationID);
@@ -2066,14 +2601,14 @@ GList *tty_search_for_serial_devices(void)
     IOObjectRelease(iter);
 
     /* Check if device list is empty */
-    if (!device_list)
+    if (device_list->len == 0)
     {
         tio_error_print("No serial devices found");
         return NULL;
     }
 
     /* Sort device list by uptime */
-    device_list = g_list_sort(device_list, compare_uptime);
+    g_ptr_array_sort(device_list, compare_uptime);
 
     /* Print header for device listing */
     print_padded("Device", listing_device_name_length_max, ' ');
@@ -2082,9 +2617,9 @@ GList *tty_search_for_serial_devices(void)
     printf(" ---- -------------- ---------------- --------------------------\n");
 
     /* Print sorted device list */
-    for (GList *l = device_list; l; l = l->next)
+    for (guint i = 0; i < device_list->len; i++)
     {
-        device_t *dev = l->data;
+        device_t *dev = g_ptr_array_index(device_list, i);
         printf("%-*s %-4s %14.3f %-16s %s\n",
                (int)listing_device_name_length_max, dev->path,
                dev->tid ?: "",
@@ -2097,129 +2632,351 @@ GList *tty_search_for_serial_devices(void)
     return device_list;
 }
 
-#else
+#else
+
+GPtrArray *tty_search_for_serial_devices(void)
+{
+    DIR *dir;
+    char path[PATH_MAX] = {};
+    double current_time, creation_time;
+
+    search_reset();
+
+    // Open the directory containing serial devices
+    dir = opendir(PATH_SERIAL_DEVICES);
+    if (!dir)
+    {
+        return NULL;
+    }
+
+    current_time = get_current_time();
+
+    // Iterate through each device in the subsystem directory
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        // Skip . and .. entries
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        // Construct the path to the TTY device file
+        snprintf(path, sizeof(path), PATH_SERIAL_DEVICES "/%s", entry->d_name);
+
+        // Skip non serial devices
+        if (is_serial_device(path) == false)
+        {
+            continue;
+        }
+
+        // Calculate uptime
+        creation_time = fs_get_creation_time(path);
+        double uptime = current_time - creation_time;
+
+        // Do not add devices excluded by exclude patterns
+        if (match_patterns(path, option.exclude_devices))
+        {
+            continue;
+        }
+
+        // Allocate new device item for device list
+        device_t *device = g_new0(device_t, 1);
+        if (device == NULL)
+        {
+            continue;
+        }
+
+        // Fill in device information
+        device->path = g_strdup(path);
+        device->tid = g_strdup("");
+        device->uptime = uptime;
+        device->driver = g_strdup("");
+        device->description = g_strdup("");
+
+        // Add device information to device list
+        g_ptr_array_add(device_list, device);
+
+        // Update length of longest device name string
+        if (strlen(device->path) > listing_device_name_length_max)
+        {
+            listing_device_name_length_max = strlen(device->path);
+        }
+    }
+
+    closedir(dir);
+
+    if (device_list->len == 0)
+    {
+        // Return NULL if no serial devices found
+        return NULL;
+    }
+
+    // Sort device list device with respect to uptime
+    g_ptr_array_sort(device_list, compare_uptime);
+
+    return device_list;
+}
+
+#endif
+
+#if !defined(__linux__)
+
+static const char *tid_index_lookup(const char *tid)
+{
+    UNUSED(tid);
+    return NULL;
+}
+
+static void tid_index_store(void)
+{
+}
+
+static int probe_fd(void)
+{
+    return -1;
+}
+
+#endif
+
+void list_serial_devices(void)
+{
+    tty_search_for_serial_devices();
+
+    if (device_list->len > 0)
+    {
+        if (listing_device_name_length_max < 17)
+        {
+            listing_device_name_length_max = 17;
+        }
+        print_padded("Device", listing_device_name_length_max, ' ');
+        printf(" TID     Uptime [s] Driver           Description\n");
+        print_padded("", listing_device_name_length_max, '-');
+        printf(" ---- ------------- ---------------- --------------------------\n");
+
+        // Iterate through the device list
+        for (guint i = 0; i < device_list->len; i++)
+        {
+            device_t *device = g_ptr_array_index(device_list, i);
+
+            // Print device information
+            print_padded(device->path, listing_device_name_length_max, ' ');
+            printf(" %4s %13.3f %-16s %s\n", device->tid, device->uptime, device->driver, device->description);
+        }
+        printf("\n");
+    }
+
+#ifdef PATH_SERIAL_DEVICES_BY_ID
+    list_serial_device_links("By-id", PATH_SERIAL_DEVICES_BY_ID);
+#endif
+#ifdef PATH_SERIAL_DEVICES_BY_PATH
+    list_serial_device_links("\nBy-path", PATH_SERIAL_DEVICES_BY_PATH);
+#endif
+}
+
+static void json_append_string(GString *out, const char *string)
+{
+    g_string_append_c(out, '"');
+
+    for (const unsigned char *c = (const unsigned char *) (string ? string : ""); *c != '\0'; c++)
+    {
+        switch (*c)
+        {
+            case '"':
+                g_string_append(out, "\\\"");
+                break;
+            case '\\':
+                g_string_append(out, "\\\\");
+                break;
+            case '\n':
+                g_string_append(out, "\\n");
+                break;
+            case '\r':
+                g_string_append(out, "\\r");
+                break;
+            case '\t':
+                g_string_append(out, "\\t");
+                break;
+            default:
+                if (*c < 0x20)
+                {
+                    g_string_append_printf(out, "\\u%04x", *c);
+                }
+                else
+                {
+                    g_string_append_c(out, *c);
+                }
+                break;
+        }
+    }
+
+    g_string_append_c(out, '"');
+}
+
+/* Format device event as a line of JSON */
+static void monitor_event_format(GString *out, const char *event, const device_t *device, double current_time)
+{
+    g_string_append_printf(out, "{\"event\":\"%s\",\"path\":", event);
+    json_append_string(out, device->path);
+    g_string_append(out, ",\"tid\":");
+    json_append_string(out, device->tid);
+    g_string_append(out, ",\"driver\":");
+    json_append_string(out, device->driver);
+    g_string_append(out, ",\"description\":");
+    json_append_string(out, device->description);
+    g_string_append_printf(out, ",\"uptime\":%.3f}\n", current_time - device->creation_time);
+}
+
+/* Devices reported by monitor, keyed by path */
+static GHashTable *monitor_devices = NULL;
 
-GList *tty_search_for_serial_devices(void)
+/* Send add events of all present devices to new socket client */
+static void monitor_client_connect(int fd)
 {
-    DIR *dir;
-    char path[PATH_MAX] = {};
-    double current_time, creation_time;
+    GString *out = g_string_new(NULL);
+    double current_time = get_current_time();
+    GHashTableIter iter;
+    gpointer value;
 
-    search_reset();
+    g_hash_table_iter_init(&iter, monitor_devices);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        monitor_event_format(out, "add", (device_t *) value, current_time);
+    }
 
-    // Open the directory containing serial devices
-    dir = opendir(PATH_SERIAL_DEVICES);
-    if (!dir)
+    // Queued like later events if client does not accept it at once
+    if (!socket_write_client(fd, out->str, out->len))
     {
-        return NULL;
+        tio_error_printf_silent("Failed to send device list to socket client");
     }
 
-    current_time = get_current_time();
+    g_string_free(out, TRUE);
+}
 
-    // Iterate through each device in the subsystem directory
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
+static device_t *device_copy(const device_t *device)
+{
+    device_t *copy = g_new0(device_t, 1);
+
+    *copy = *device;
+    copy->tid = g_strdup(device->tid);
+    copy->path = g_strdup(device->path);
+    copy->driver = g_strdup(device->driver);
+    copy->description = g_strdup(device->description);
+
+    return copy;
+}
+
+/* Stream serial device add and remove events as lines of JSON to stdout and
+ * socket clients. Device searches are triggered by hotplug events, falling
+ * back to polling where these are not available. */
+int tty_monitor_devices(void)
+{
+    GString *out = g_string_new(NULL);
+    fd_set rdfs, wrfs;
+    int maxfd, interval;
+    char input_char;
+
+    monitor_devices = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, device_free);
+    socket_set_connect_handler(monitor_client_connect);
+
+    while (true)
     {
-        // Skip . and .. entries
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-        {
-            continue;
-        }
+        GHashTable *present = g_hash_table_new(g_str_hash, g_str_equal);
+        GHashTableIter iter;
+        gpointer value;
 
-        // Construct the path to the TTY device file
-        snprintf(path, sizeof(path), PATH_SERIAL_DEVICES "/%s", entry->d_name);
+        tty_search_for_serial_devices();
+        double current_time = get_current_time();
 
-        // Skip non serial devices
-        if (is_serial_device(path) == false)
+        for (guint i = 0; i < device_list->len; i++)
         {
-            continue;
+            device_t *device = g_ptr_array_index(device_list, i);
+            g_hash_table_insert(present, device->path, device);
         }
 
-        // Calculate uptime
-        creation_time = fs_get_creation_time(path);
-        double uptime = current_time - creation_time;
-
-        // Do not add devices excluded by exclude patterns
-        if (match_patterns(path, option.exclude_devices))
+        // Report removed devices, a replaced device is reported as removed and added
+        g_hash_table_iter_init(&iter, monitor_devices);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
         {
-            continue;
+            device_t *known = (device_t *) value;
+            device_t *device = g_hash_table_lookup(present, known->path);
+
+            if ((device == NULL) || (device->creation_time != known->creation_time))
+            {
+                monitor_event_format(out, "remove", known, current_time);
+                g_hash_table_iter_remove(&iter);
+            }
         }
 
-        // Allocate new device item for device list
-        device_t *device = g_new0(device_t, 1);
-        if (device == NULL)
+        // Report added devices, oldest first
+        for (guint i = 0; i < device_list->len; i++)
         {
-            continue;
-        }
+            device_t *device = g_ptr_array_index(device_list, i);
 
-        // Fill in device information
-        device->path = g_strdup(path);
-        device->tid = g_strdup("");
-        device->uptime = uptime;
-        device->driver = g_strdup("");
-        device->description = g_strdup("");
+            if (g_hash_table_lookup(monitor_devices, device->path) == NULL)
+            {
+                device_t *copy = device_copy(device);
+                g_hash_table_insert(monitor_devices, copy->path, copy);
+                monitor_event_format(out, "add", copy, current_time);
+            }
+        }
 
-        // Add device information to device list
-        device_list = g_list_append(device_list, device);
+        g_hash_table_destroy(present);
 
-        // Update length of longest device name string
-        if (strlen(device->path) > listing_device_name_length_max)
+        if (out->len > 0)
         {
-            listing_device_name_length_max = strlen(device->path);
+            fwrite(out->str, 1, out->len, stdout);
+            fflush(stdout);
+            socket_write_data(out->str, out->len);
+            g_string_truncate(out, 0);
         }
-    }
-
-    if (g_list_length(device_list) == 0)
-    {
-        // Return NULL if no serial devices found
-        return NULL;
-    }
-
-    // Sort device list device with respect to uptime
-    device_list = g_list_sort(device_list, compare_uptime);
 
-    closedir(dir);
-
-    return device_list;
-}
-
-#endif
-
-void list_serial_devices(void)
-{
-    tty_search_for_serial_devices();
+        // Wait for hotplug event or completion of a probe the search gave up on
+        interval = (hotplug_fd() == -1) ? DEVICE_WAIT_POLL_INTERVAL : DEVICE_WAIT_EVENT_INTERVAL;
+        struct timeval tv = { .tv_sec = interval / 1000, .tv_usec = (interval % 1000) * 1000 };
 
-    if (g_list_length(device_list) > 0)
-    {
-        if (listing_device_name_length_max < 17)
+        FD_ZERO(&rdfs);
+        FD_ZERO(&wrfs);
+        maxfd = socket_add_fds(&rdfs, &wrfs, true);
+        if (hotplug_fd() != -1)
         {
-            listing_device_name_length_max = 17;
+            FD_SET(hotplug_fd(), &rdfs);
+            maxfd = MAX(maxfd, hotplug_fd());
+        }
+        if (probe_fd() != -1)
+        {
+            // Drained by the next search
+            FD_SET(probe_fd(), &rdfs);
+            maxfd = MAX(maxfd, probe_fd());
         }
-        print_padded("Device", listing_device_name_length_max, ' ');
-        printf(" TID     Uptime [s] Driver           Description\n");
-        print_padded("", listing_device_name_length_max, '-');
-        printf(" ---- ------------- ---------------- --------------------------\n");
 
-        // Iterate through the device list
-        GList *iter;
-        for (iter = device_list; iter != NULL; iter = g_list_next(iter))
+        int status = select(maxfd + 1, &rdfs, &wrfs, NULL, &tv);
+        if (status > 0)
         {
-            device_t *device = (device_t *) iter->data;
+            socket_handle_output(&wrfs);
 
-            // Print device information
-            print_padded(device->path, listing_device_name_length_max, ' ');
-            printf(" %4s %13.3f %-16s %s\n", device->tid, device->uptime, device->driver, device->description);
+            // Input from socket clients is discarded
+            socket_handle_input(&rdfs, &input_char);
+
+            if ((hotplug_fd() != -1) && FD_ISSET(hotplug_fd(), &rdfs))
+            {
+                hotplug_handle();
+            }
+        }
+        else if ((status == -1) && (errno != EINTR))
+        {
+            tio_error_printf("select() failed (%s)", strerror(errno));
+            break;
         }
-        printf("\n");
     }
 
-    list_serial_devices_by_id();
-    list_serial_devices_by_path();
+    g_string_free(out, TRUE);
+
+    return EXIT_FAILURE;
 }
 
 void tty_search(void)
 {
-    GList *iter;
     device_t *device = NULL;
     double uptime_minimum = 0;
     bool no_new = true;
@@ -2230,11 +2987,10 @@ void tty_search(void)
             tty_search_for_serial_devices();
 
             // Save smallest uptime
-            if (g_list_length(device_list) > 0)
+            if (device_list->len > 0)
             {
                 // Get latest registered device (smallest uptime)
-                GList *last = g_list_last(device_list);
-                device = last->data;
+                device = g_ptr_array_index(device_list, device_list->len - 1);
                 uptime_minimum = device->uptime;
             }
 
@@ -2245,9 +3001,9 @@ void tty_search(void)
                 tty_search_for_serial_devices();
 
                 // Iterate through the device list generated by search
-                for (iter = device_list; iter != NULL; iter = g_list_next(iter))
+                for (guint i = 0; i < device_list->len; i++)
                 {
-                    device = (device_t *) iter->data;
+                    device = g_ptr_array_index(device_list, i);
 
                     // Find first new device
                     if (device->uptime < uptime_minimum)
@@ -2260,18 +3016,18 @@ void tty_search(void)
                 }
                 if (no_new)
                 {
-                    usleep(500*1000); // Sleep 0.5 s
+                    // Wait for tty hotplug event, only poll when events are not available
+                    hotplug_wait((hotplug_fd() == -1) ? DEVICE_WAIT_POLL_INTERVAL : DEVICE_WAIT_EVENT_INTERVAL);
                 }
             }
             return;
 
         case AUTO_CONNECT_LATEST:
             tty_search_for_serial_devices();
-            if (g_list_length(device_list) > 0)
+            if (device_list->len > 0)
             {
                 // Get latest registered device (smallest uptime)
-                GList *last = g_list_last(device_list);
-                device = last->data;
+                device = g_ptr_array_index(device_list, device_list->len - 1);
                 device_name = device->path;
             }
             return;
@@ -2291,13 +3047,22 @@ void tty_search(void)
 
             if (strlen(device_name) == TOPOLOGY_ID_SIZE)
             {
-                // Potential topology ID detected -> trigger device search
+                // Potential topology ID detected -> try index of last search
+                const char *path = tid_index_lookup(device_name);
+                if (path != NULL)
+                {
+                    device_name = path;
+                    return;
+                }
+
+                // Not indexed -> trigger device search
                 tty_search_for_serial_devices();
+                tid_index_store();
 
                 // Iterate through the device list generated by search
-                for (iter = device_list; iter != NULL; iter = g_list_next(iter))
+                for (guint i = 0; i < device_list->len; i++)
                 {
-                    device = (device_t *) iter->data;
+                    device = g_ptr_array_index(device_list, i);
 
                     if (strcmp(device->tid, device_name) == 0)
                     {
@@ -2320,44 +3085,61 @@ void tty_search(void)
 void tty_wait_for_device(void)
 {
     fd_set rdfs;
+    fd_set wrfs;
     int    status;
     int    maxfd;
     struct timeval tv;
     static char input_char;
     static bool first = true;
     static int last_errno = 0;
+    int    watch, interval;
+
+    double wait_time = get_current_time();
 
     /* Loop until device pops up */
     while (true)
     {
         tty_search();
 
+        /* Watch for device node to appear, only poll when events are not
+         * available */
+        watch = hotplug_watch(device_name);
+        interval = (watch == 0) ? DEVICE_WAIT_EVENT_INTERVAL : DEVICE_WAIT_POLL_INTERVAL;
+
         if (interactive_mode)
         {
             /* In interactive mode, while waiting for tty device, we need to
              * read from stdin to react on input key commands. */
-            if (first)
+            if (first || (watch > 0))
             {
-                /* Don't wait first time */
+                /* Don't wait first time or when watching new directories */
                 tv.tv_sec = 0;
                 tv.tv_usec = 1;
                 first = false;
             }
             else
             {
-                /* Wait up to 1 second for input */
-                tv.tv_sec = 1;
-                tv.tv_usec = 0;
+                /* Wait for input or hotplug event */
+                tv.tv_sec = interval / 1000;
+                tv.tv_usec = (interval % 1000) * 1000;
             }
 
             FD_ZERO(&rdfs);
+            FD_ZERO(&wrfs);
             FD_SET(pipefd[0], &rdfs);
-            maxfd = MAX(pipefd[0], socket_add_fds(&rdfs, false));
+            maxfd = MAX(pipefd[0], socket_add_fds(&rdfs, &wrfs, false));
+            if (hotplug_fd() != -1)
+            {
+                /* Wake up as soon as a tty device is added or removed */
+                FD_SET(hotplug_fd(), &rdfs);
+                maxfd = MAX(maxfd, hotplug_fd());
+            }
 
             /* Block until input becomes available or timeout */
-            status = select(maxfd + 1, &rdfs, NULL, NULL, &tv);
+            status = select(maxfd + 1, &rdfs, &wrfs, NULL, &tv);
             if (status > 0)
             {
+                socket_handle_output(&wrfs);
                 if (FD_ISSET(pipefd[0], &rdfs))
                 {
                     /* Input from stdin ready */
@@ -2374,6 +3156,10 @@ void tty_wait_for_device(void)
                     handle_command_sequence(input_char, NULL, NULL);
                 }
                 socket_handle_input(&rdfs, NULL);
+                if ((hotplug_fd() != -1) && FD_ISSET(hotplug_fd(), &rdfs))
+                {
+                    hotplug_handle();
+                }
             }
             else if (status == -1)
             {
@@ -2399,6 +3185,12 @@ void tty_wait_for_device(void)
         status = access(device_name, R_OK);
         if (status == 0)
         {
+            /* Device appeared when announced by hotplug event, if any */
+            reconnect.appear_time = get_current_time();
+            if (hotplug_last_event_time() >= wait_time)
+            {
+                reconnect.appear_time = hotplug_last_event_time();
+            }
             last_errno = 0;
             return;
         }
@@ -2409,12 +3201,11 @@ void tty_wait_for_device(void)
             last_errno = errno;
         }
 
-        if (!interactive_mode)
+        if ((!interactive_mode) && (watch <= 0))
         {
             /* In non-interactive mode we do not need to handle input key
-             * commands so we simply sleep 1 second between checking for
-             * presence of tty device */
-            sleep(1);
+             * commands so we simply wait for a hotplug event */
+            hotplug_wait(interval);
         }
     }
 }
@@ -2427,6 +3218,7 @@ void tty_disconnect(void)
         flock(device_fd, LOCK_UN);
         close(device_fd);
         connected = false;
+        reconnect.disconnect_time = get_current_time();
 
         /* Fire alert action */
         alert_disconnect();
@@ -2544,31 +3336,43 @@ void forward_to_tty(int fd, char output_char)
     }
 }
 
-int tty_connect(void)
+/* Forward output through script transmit hook */
+static void forward_to_tty_hooked(int fd, const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+
+    data = script_hooks_tx(fd, data, &len);
+    for (size_t i = 0; i < len; i++)
+    {
+        forward_to_tty(fd, data[i]);
+    }
+}
+
+/* Open, lock and configure tty device. Current port settings are saved on
+ * first open only, on reopen new settings are applied right away so no early
+ * output of the device is lost or garbled.
+ */
+static int tty_open_configure(void)
 {
-    fd_set rdfs;           /* Read file descriptor set */
-    int    maxfd;          /* Maximum file descriptor used */
-    char   input_char, output_char;
-    char   input_buffer[BUFSIZ] = {};
     static bool first = true;
-    int    status;
-    bool   do_timestamp = false;
-    char*  now = NULL;
-    struct timeval tval_before = {}, tval_now, tval_result;
+    int status;
 
     /* Open tty device */
     device_fd = open(device_name, O_RDWR | O_NOCTTY | O_NONBLOCK);
     if (device_fd < 0)
     {
         tio_error_printf_silent("Could not open tty device (%s)", strerror(errno));
-        goto error_open;
+        return TIO_ERROR;
     }
 
     /* Make sure device is of tty type */
     if (!isatty(device_fd))
     {
         tio_error_printf("Not a tty device");
-        exit(EXIT_FAILURE);;
+        exit(EXIT_FAILURE);
     }
 
     /* Lock device file */
@@ -2579,40 +3383,27 @@ int tty_connect(void)
         exit(EXIT_FAILURE);
     }
 
-    /* Flush stale I/O data (if any) */
-    tcflush(device_fd, TCIOFLUSH);
-
-    /* Print connect status */
-    tio_printf("Connected to %s", device_name);
-    connected = true;
-    print_tainted = false;
-
-    /* Fire alert action */
-    alert_connect();
-
-    if (option.timestamp)
+    if (first)
     {
-        do_timestamp = true;
-    }
-
-    /* Manage print output mode */
-    tty_output_mode_set(option.output_mode);
+        /* Flush stale I/O data (if any) */
+        tcflush(device_fd, TCIOFLUSH);
 
-    /* Save current port settings */
-    if (tcgetattr(device_fd, &tio_old) < 0)
-    {
-        tio_error_printf_silent("Could not get port settings (%s)", strerror(errno));
-        goto error_tcgetattr;
-    }
+        /* Save current port settings */
+        if (tcgetattr(device_fd, &tio_old) < 0)
+        {
+            tio_error_printf_silent("Could not get port settings (%s)", strerror(errno));
+            goto error;
+        }
 
 #ifdef HAVE_IOSSIOSPEED
-    if (!standard_baudrate)
-    {
-        /* OS X wants these fields left alone before setting arbitrary baud rate */
-        tio.c_ispeed = tio_old.c_ispeed;
-        tio.c_ospeed = tio_old.c_ospeed;
-    }
+        if (!standard_baudrate)
+        {
+            /* OS X wants these fields left alone before setting arbitrary baud rate */
+            tio.c_ispeed = tio_old.c_ispeed;
+            tio.c_ospeed = tio_old.c_ospeed;
+        }
 #endif
+    }
 
     /* Manage RS-485 mode */
     if (option.rs485)
@@ -2632,7 +3423,7 @@ int tty_connect(void)
     if (status == -1)
     {
         tio_error_printf_silent("Could not apply port settings (%s)", strerror(errno));
-        goto error_tcsetattr;
+        goto error;
     }
 
     /* Set arbitrary baudrate (only works on supported platforms) */
@@ -2641,10 +3432,112 @@ int tty_connect(void)
         if (setspeed(device_fd, option.baudrate) != 0)
         {
             tio_error_printf_silent("Could not set baudrate speed (%s)", strerror(errno));
-            goto error_setspeed;
+            goto error;
+        }
+    }
+
+    return TIO_SUCCESS;
+
+error:
+    flock(device_fd, LOCK_UN);
+    close(device_fd);
+    return TIO_ERROR;
+}
+
+int tty_transfer(void)
+{
+    int status;
+
+    /* Headless transfer is a single attempt, report open errors on exit */
+    option.no_reconnect = true;
+
+    /* Resolve target to tty device */
+    tty_search();
+
+    /* Open and configure tty device */
+    if (tty_open_configure() != TIO_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (option.transfer == TRANSFER_SEND)
+    {
+        tio_printf("Sending file '%s' to %s", option.transfer_filename, device_name);
+        if (option.transfer_protocol == KERMIT)
+        {
+            status = kermit_send(device_fd, option.transfer_filename);
+        }
+        else
+        {
+            status = xymodem_send(device_fd, option.transfer_filename, option.transfer_protocol);
+        }
+    }
+    else
+    {
+        tio_printf("Receiving file '%s' from %s", option.transfer_filename, device_name);
+        if (option.transfer_protocol == KERMIT)
+        {
+            status = kermit_receive(device_fd, option.transfer_filename);
+        }
+        else
+        {
+            status = xymodem_receive(device_fd, option.transfer_filename, option.transfer_protocol);
         }
     }
 
+    tio_printf("Transfer %s", status < 0 ? "failed" : "complete");
+
+    return (status < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int tty_connect(void)
+{
+    fd_set rdfs;           /* Read file descriptor set */
+    fd_set wrfs;           /* Write file descriptor set */
+    int    maxfd;          /* Maximum file descriptor used */
+    char   input_char, output_char;
+    char   input_buffer[BUFSIZ] = {};
+    char   tx_data[BUFSIZ];
+    size_t tx_count = 0;
+    int    status;
+    bool   do_timestamp = false;
+    char*  now = NULL;
+    struct timeval tval_before = {}, tval_now, tval_result;
+
+    /* Open and configure tty device */
+    if (tty_open_configure() != TIO_SUCCESS)
+    {
+        return TIO_ERROR;
+    }
+    connected = true;
+
+    /* Update reconnect statistics */
+    if (reconnect.disconnect_time > 0)
+    {
+        double now_time = get_current_time();
+
+        reconnect.count++;
+        reconnect.gap = now_time - reconnect.disconnect_time;
+        reconnect.gap_max = MAX(reconnect.gap, reconnect.gap_max);
+        reconnect.latency = MAX(now_time - reconnect.appear_time, 0);
+        reconnect.latency_max = MAX(reconnect.latency, reconnect.latency_max);
+    }
+
+    /* Print connect status */
+    tio_printf("Connected to %s", device_name);
+    print_tainted = false;
+
+    /* Fire alert action */
+    alert_connect();
+
+    if (option.timestamp)
+    {
+        do_timestamp = true;
+    }
+
+    /* Manage print output mode */
+    tty_output_mode_set(option.output_mode);
+
     /* If stdin is a pipe forward all input to tty device */
     if (interactive_mode == false)
     {
@@ -2688,6 +3581,8 @@ int tty_connect(void)
     // Exit if piped input
     if (interactive_mode == false)
     {
+        // Let script tasks finish first
+        script_tasks_finish(device_fd);
         exit(EXIT_SUCCESS);
     }
 
@@ -2703,18 +3598,34 @@ int tty_connect(void)
     /* Input loop */
     while (true)
     {
+        struct timeval tv, *timeout = NULL;
+        int task_timeout;
+
+        /* Run due script tasks and wake up for next one */
+        script_tasks_run(device_fd);
+        task_timeout = script_tasks_timeout();
+        if (task_timeout >= 0)
+        {
+            tv.tv_sec = task_timeout / 1000;
+            tv.tv_usec = (task_timeout % 1000) * 1000;
+            timeout = &tv;
+        }
+
         FD_ZERO(&rdfs);
+        FD_ZERO(&wrfs);
         FD_SET(device_fd, &rdfs);
         FD_SET(pipefd[0], &rdfs);
 
         maxfd = MAX(device_fd, pipefd[0]);
-        maxfd = MAX(maxfd, socket_add_fds(&rdfs, true));
+        maxfd = MAX(maxfd, socket_add_fds(&rdfs, &wrfs, true));
 
         /* Block until input becomes available */
-        status = select(maxfd + 1, &rdfs, NULL, NULL, NULL);
+        status = select(maxfd + 1, &rdfs, &wrfs, NULL, timeout);
         if (status > 0)
         {
             bool forward = false;
+
+            socket_handle_output(&wrfs);
             if (FD_ISSET(device_fd, &rdfs))
             {
                 /*******************************/
@@ -2732,6 +3643,15 @@ int tty_connect(void)
                 /* Update receive statistics */
                 rx_total += bytes_read;
 
+                /* Pass received data through script hooks */
+                const char *rx_data = input_buffer;
+                if (script_hooks_rx_active())
+                {
+                    size_t len = bytes_read;
+                    rx_data = script_hooks_rx(device_fd, input_buffer, &len);
+                    bytes_read = len;
+                }
+
                 // Manage timeout based timestamping in hex mode
                 if ((option.output_mode == OUTPUT_MODE_HEX) && (option.hex_n_value == 0))
                 {
@@ -2761,7 +3681,7 @@ int tty_connect(void)
                 {
                     static unsigned long count = 0;
 
-                    input_char = input_buffer[i];
+                    input_char = rx_data[i];
 
                     /* Handle timestamps */
                     switch (option.output_mode)
@@ -2973,10 +3893,21 @@ int tty_connect(void)
 
                     if (forward)
                     {
-                        forward_to_tty(device_fd, output_char);
+                        if (script_hooks_tx_active())
+                        {
+                            // Collect output for script hook
+                            tx_data[tx_count++] = output_char;
+                        }
+                        else
+                        {
+                            forward_to_tty(device_fd, output_char);
+                        }
                     }
                 }
 
+                forward_to_tty_hooked(device_fd, tx_data, tx_count);
+                tx_count = 0;
+
                 tty_sync(device_fd);
             }
             else
@@ -2989,7 +3920,14 @@ int tty_connect(void)
 
                 if (forward)
                 {
-                    forward_to_tty(device_fd, output_char);
+                    if (script_hooks_tx_active())
+                    {
+                        forward_to_tty_hooked(device_fd, &output_char, 1);
+                    }
+                    else
+                    {
+                        forward_to_tty(device_fd, output_char);
+                    }
                 }
 
                 tty_sync(device_fd);
@@ -3015,18 +3953,13 @@ int tty_connect(void)
         }
         else
         {
-            // Timeout (only happens in response wait mode)
-            exit(EXIT_FAILURE);
+            // Timeout, script task due
         }
     }
 
     return TIO_SUCCESS;
 
-error_setspeed:
-error_tcsetattr:
-error_tcgetattr:
 error_read:
     tty_disconnect();
-error_open:
     return TIO_ERROR;
 }
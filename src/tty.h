@@ -22,6 +22,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <sys/types.h>
 #include <glib.h>
 
 #define LINE_HIGH true
@@ -56,10 +57,12 @@ typedef enum
 typedef struct
 {
     char *tid;
+    double creation_time;
     double uptime;
     char *path;
     char *driver;
     char *description;
+    dev_t rdev;
 } device_t;
 
 typedef struct
@@ -77,10 +80,12 @@ void stdin_configure(void);
 void tty_configure(void);
 void tty_reconfigure(void);
 int tty_connect(void);
+int tty_transfer(void);
 void tty_wait_for_device(void);
 void list_serial_devices(void);
 void tty_input_thread_create(void);
 void tty_input_thread_wait_ready(void);
 void tty_line_set(int fd, tty_line_config_t line_config[]);
 void tty_search(void);
-GList *tty_search_for_serial_devices(void);
+int tty_monitor_devices(void);
+GPtrArray *tty_search_for_serial_devices(void);
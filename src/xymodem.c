@@ -9,14 +9,17 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <poll.h>
+#include <time.h>
 #include "xymodem.h"
 #include "print.h"
 #include "misc.h"
+#include "progress.h"
 
 #define SOH 0x01
 #define STX 0x02
@@ -38,7 +41,21 @@
 
 #define RX_IGNORE 5
 
+/* Adaptive timeout limits [ms]. A receiver that is slow to respond to some
+ * blocks, e.g. a bootloader erasing flash, may answer after the block has been
+ * retransmitted. Every copy of a block is answered, so responses still owed
+ * for earlier copies are discarded once the block has been acknowledged.
+ */
+#define RTO_INITIAL   1000
+#define RTO_MIN        100
+#define RTO_MAX       8000
+#define RETRY_MAX       10
+
+/* Drain poll [ms] used until first round-trip time has been measured */
+#define DRAIN_POLL      50
+
 #define min(a, b)       ((a) < (b) ? (a) : (b))
+#define max(a, b)       ((a) > (b) ? (a) : (b))
 
 struct xpacket_1k {
     uint8_t  type;
@@ -58,33 +75,137 @@ struct xpacket {
     uint8_t  crc_lo;
 } __attribute__((packed));
 
-/* See https://en.wikipedia.org/wiki/Computation_of_cyclic_redundancy_checks */
-static uint16_t crc16(const uint8_t *data, uint16_t size)
+/* Round-trip time estimator and transfer counters. Timeouts are derived
+ * from measured block round-trip times as described in RFC 6298 (smoothed
+ * RTT plus four times RTT variance) and backed off exponentially, bounded by
+ * RTO_MAX, on each timeout.
+ */
+static struct
 {
-    uint16_t crc, s;
+    long srtt;              /* Smoothed round-trip time [us] */
+    long rttvar;            /* Round-trip time variance [us] */
+    long rto;               /* Current retransmission timeout [us] */
+    unsigned long blocks;
+    unsigned long retries;
+    unsigned long timeouts;
+} xy;
+
+static long time_now_us(void)
+{
+    struct timespec ts;
 
-    for (crc = 0; size > 0; size--) {
-        s = *data++ ^ (crc >> 8);
-        s ^= (s >> 4);
-        crc = (crc << 8) ^ s ^ (s << 5) ^ (s << 12);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static void timing_reset(void)
+{
+    xy.srtt = 0;
+    xy.rttvar = 0;
+    xy.rto = RTO_INITIAL * 1000L;
+    xy.blocks = 0;
+    xy.retries = 0;
+    xy.timeouts = 0;
+}
+
+static void timing_sample(long rtt)
+{
+    if (rtt < 0)
+    {
+        rtt = 0;
     }
-    return crc;
+
+    if (xy.srtt == 0)
+    {
+        xy.srtt = max(rtt, 1);
+        xy.rttvar = rtt / 2;
+    }
+    else
+    {
+        xy.rttvar = (3 * xy.rttvar + labs(xy.srtt - rtt)) / 4;
+        xy.srtt = max((7 * xy.srtt + rtt) / 8, 1);
+    }
+
+    xy.rto = min(max(xy.srtt + 4 * xy.rttvar, RTO_MIN * 1000L), RTO_MAX * 1000L);
 }
 
-static int xmodem_1k(int sio, const void *data, size_t len, int seq)
+static void timing_backoff(void)
 {
-    struct xpacket_1k  packet;
-    const uint8_t  *buf = data;
-    char            resp = 0;
-    int             rc, crc;
+    xy.timeouts++;
+    xy.rto = min(xy.rto * 2, RTO_MAX * 1000L);
+}
+
+/* Timeout [ms] for a response to a block of len bytes */
+static int timing_timeout(size_t len)
+{
+    return (xy.rto + line_time_us(len) + 999) / 1000;
+}
+
+/* Quiet period [ms] used to detect that the line has been drained */
+static int timing_drain(void)
+{
+    if (xy.srtt == 0)
+    {
+        return DRAIN_POLL;
+    }
+
+    return min(max((2 * xy.srtt + 999) / 1000, 5), DRAIN_POLL);
+}
+
+/* Read up to len bytes, waiting at most timeout ms. Polls in short slices so
+ * that a key hit aborts the wait promptly.
+ */
+static int xy_read(int sio, void *data, size_t len, int timeout)
+{
+    long deadline = time_now_us() + timeout * 1000L;
+    int rc;
+
+    while (1) {
+        long remaining = (deadline - time_now_us() + 999) / 1000;
+
+        if (key_hit)
+            return USER_CAN;
+        if (remaining <= 0)
+            return 0;
+        rc = read_poll(sio, data, len, min(remaining, DRAIN_POLL));
+        if (rc != 0)
+            return rc;
+    }
+}
+
+/* Read exactly len bytes unless timeout ms elapse first */
+static int xy_read_full(int sio, void *data, size_t len, int timeout)
+{
+    long deadline = time_now_us() + timeout * 1000L;
+    uint8_t *p = data;
+    size_t count = 0;
+    int rc;
+
+    while (count < len) {
+        long remaining = (deadline - time_now_us() + 999) / 1000;
+
+        if (remaining <= 0)
+            return 0;
+        rc = xy_read(sio, p + count, len - count, remaining);
+        if (rc <= 0)
+            return rc;
+        count += rc;
+    }
+    return count;
+}
+
+/* Drain pending characters from serial line. Insist on the last drained
+ * character being 'C'.
+ */
+static int sync_receiver(int sio)
+{
+    char resp = 0;
+    int  rc;
 
-    /* Drain pending characters from serial line. Insist on the
-     * last drained character being 'C'.
-     */
     while(1) {
         if (key_hit)
-            return -1;
-        rc = read_poll(sio, &resp, 1, 50);
+            return ERR;
+        rc = read_poll(sio, &resp, 1, timing_drain());
         if (rc == 0) {
             if (resp == 'C') break;
             if (resp == CAN) return ERR;
@@ -95,6 +216,81 @@ static int xmodem_1k(int sio, const void *data, size_t len, int seq)
             return ERR;
         }
     }
+    return OK;
+}
+
+/* Wait for receiver response to block of len bytes written at time sent.
+ * Returns response character, 0 on timeout or negative on error.
+ */
+static int wait_response(int sio, size_t len, long sent, bool retransmit)
+{
+    char resp = 0;
+    int  rc;
+
+    rc = xy_read(sio, &resp, 1, timing_timeout(len));
+    if (rc == USER_CAN)
+        return ERR;
+    if (rc < 0) {
+        tio_error_print("Read ack/nak from serial failed");
+        return ERR;
+    }
+    if (rc == 0) {
+        timing_backoff();
+        return 0;
+    }
+
+    /* Karn's algorithm: only sample round trips of first transmissions */
+    if (!retransmit)
+        timing_sample(time_now_us() - sent - line_time_us(len));
+
+    return (uint8_t) resp;
+}
+
+/* Discard count responses still owed for earlier copies of an acknowledged
+ * block of len bytes, so they are not taken for responses to the next block.
+ * Gives up on a copy that is not answered within the timeout.
+ */
+static int discard_responses(int sio, size_t len, int count)
+{
+    char resp;
+    int  rc;
+
+    while (count-- > 0) {
+        rc = xy_read(sio, &resp, 1, timing_timeout(len));
+        if (rc < 0) {
+            if (rc != USER_CAN)
+                tio_error_print("Read ack/nak from serial failed");
+            return ERR;
+        }
+        if (rc == 0)
+            break;
+    }
+    return OK;
+}
+
+/* See https://en.wikipedia.org/wiki/Computation_of_cyclic_redundancy_checks */
+static uint16_t crc16(const uint8_t *data, uint16_t size)
+{
+    uint16_t crc, s;
+
+    for (crc = 0; size > 0; size--) {
+        s = *data++ ^ (crc >> 8);
+        s ^= (s >> 4);
+        crc = (crc << 8) ^ s ^ (s << 5) ^ (s << 12);
+    }
+    return crc;
+}
+
+static int xmodem_1k(int sio, const void *data, size_t len, int seq)
+{
+    struct xpacket_1k  packet;
+    const uint8_t  *buf = data;
+    char            resp = 0;
+    int             rc, crc, retry = 0, unanswered = 0;
+    bool            fin = (seq == 0 && len == 1 && buf[0] == 0);
+
+    if (sync_receiver(sio) < 0)
+        return ERR;
 
     /* Always work with 1K packets */
     packet.seq  = seq;
@@ -102,7 +298,8 @@ static int xmodem_1k(int sio, const void *data, size_t len, int seq)
 
     while (len) {
         size_t  sz, z = 0;
-        char   *from, status;
+        char   *from;
+        long    sent;
 
         /* Build next packet, pad with 0 to full seq */
         z = min(len, sizeof(packet.data));
@@ -130,65 +327,69 @@ static int xmodem_1k(int sio, const void *data, size_t len, int seq)
             from += rc;
             sz   -= rc;
         }
+        sent = time_now_us();
+        unanswered++;
 
-        /* Clear response */
-        resp = 0;
+        /* Read receiver response within adaptive timeout */
+        rc = wait_response(sio, sizeof(packet), sent, retry > 0);
+        if (rc < 0)
+            return ERR;
+        if (rc > 0)
+            unanswered--;
+        resp = rc;
 
         /* 'lrzsz' does not ACK ymodem's fin packet */
-        if (seq == 0 && packet.data[0] == 0) resp = ACK;
+        if (fin && resp == 0) resp = ACK;
 
-        /* Read receiver response, timeout 1 s */
-        for(int n=0; n < 20; n++) {
-            if (key_hit)
-                return ERR;
-            rc = read_poll(sio, &resp, 1, 50);
-            if (rc < 0) {
-                tio_error_print("Read ack/nak from serial failed");
-                return ERR;
-            } else if(rc > 0) {
-                break;
-            }
-        }
-
-        /* Update "progress bar" */
-        switch (resp) {
-        case NAK: status = 'N'; break;
-        case ACK: status = '.'; break;
-        case 'C': status = 'C'; break;
-        case CAN: status = '!'; return ERR;
-        default:  status = '?';
-        }
-        write(STDOUT_FILENO, &status, 1);
+        /* Cancelled by receiver */
+        if (resp == CAN)
+            return ERR;
 
         /* Move to next block after ACK */
         if (resp == ACK) {
+            if (discard_responses(sio, sizeof(packet), unanswered) < 0)
+                return ERR;
+            unanswered = 0;
             packet.seq++;
             len -= z;
             buf += z;
+            xy.blocks++;
+            retry = 0;
+            progress_update(seq ? z : 0, xy.retries);
+        }
+        else {
+            xy.retries++;
+            progress_update(0, xy.retries);
+            if (++retry > RETRY_MAX) {
+                tio_error_print("Too many retries");
+                write(sio, CAN_STR CAN_STR, 2);
+                return ERR;
+            }
         }
     }
 
-    /* Send EOT at 1 Hz until ACK or CAN received */
+    /* Send EOT until ACK or CAN received */
     while (seq) {
+        long sent;
+
         if (key_hit)
             return ERR;
         if (write(sio, EOT_STR, 1) < 0) {
             tio_error_print("Write EOT to serial failed");
             return ERR;
         }
-        write(STDOUT_FILENO, "|", 1);
-        /* 1s timeout */
-        rc = read_poll(sio, &resp, 1, 1000);
-        if (rc < 0) {
-            tio_error_print("Read from serial failed");
+        sent = time_now_us();
+        rc = wait_response(sio, 1, sent, true);
+        if (rc < 0)
             return ERR;
-        } else if(rc == 0) {
-            continue;
-        }
+        resp = rc;
         if (resp == ACK || resp == CAN) {
-            write(STDOUT_FILENO, "\r\n", 2);
             return (resp == ACK) ? OK : ERR;
         }
+        if (++retry > RETRY_MAX) {
+            tio_error_print("Too many retries");
+            return ERR;
+        }
     }
     return 0; /* not reached */
 }
@@ -198,25 +399,10 @@ static int xmodem(int sio, const void *data, size_t len)
     struct xpacket  packet;
     const uint8_t  *buf = data;
     char            resp = 0;
-    int             rc, crc;
+    int             rc, crc, retry = 0, unanswered = 0;
 
-    /* Drain pending characters from serial line. Insist on the
-     * last drained character being 'C'.
-     */
-    while(1) {
-        if (key_hit)
-            return -1;
-        rc = read_poll(sio, &resp, 1, 50);
-        if (rc == 0) {
-            if (resp == 'C') break;
-            if (resp == CAN) return ERR;
-            continue;
-        }
-        else if (rc < 0) {
-            tio_error_print("Read sync from serial failed");
-            return ERR;
-        }
-    }
+    if (sync_receiver(sio) < 0)
+        return ERR;
 
     /* Always work with 128b packets */
     packet.seq  = 1;
@@ -224,7 +410,8 @@ static int xmodem(int sio, const void *data, size_t len)
 
     while (len) {
         size_t  sz, z = 0;
-        char   *from, status;
+        char   *from;
+        long    sent;
 
         /* Build next packet, pad with 0 to full seq */
         z = min(len, sizeof(packet.data));
@@ -252,62 +439,66 @@ static int xmodem(int sio, const void *data, size_t len)
             from += rc;
             sz   -= rc;
         }
+        sent = time_now_us();
+        unanswered++;
 
-        /* Clear response */
-        resp = 0;
-
-        /* Read receiver response, timeout 1 s */
-        for(int n=0; n < 20; n++) {
-            if (key_hit)
-                return ERR;
-            rc = read_poll(sio, &resp, 1, 50);
-            if (rc < 0) {
-                tio_error_print("Read ack/nak from serial failed");
-                return ERR;
-            } else if(rc > 0) {
-                break;
-            }
-        }
+        /* Read receiver response within adaptive timeout */
+        rc = wait_response(sio, sizeof(packet), sent, retry > 0);
+        if (rc < 0)
+            return ERR;
+        if (rc > 0)
+            unanswered--;
+        resp = rc;
 
-        /* Update "progress bar" */
-        switch (resp) {
-        case NAK: status = 'N'; break;
-        case ACK: status = '.'; break;
-        case 'C': status = 'C'; break;
-        case CAN: status = '!'; return ERR;
-        default:  status = '?';
-        }
-        write(STDOUT_FILENO, &status, 1);
+        /* Cancelled by receiver */
+        if (resp == CAN)
+            return ERR;
 
         /* Move to next block after ACK */
         if (resp == ACK) {
+            if (discard_responses(sio, sizeof(packet), unanswered) < 0)
+                return ERR;
+            unanswered = 0;
             packet.seq++;
             len -= z;
             buf += z;
+            xy.blocks++;
+            retry = 0;
+            progress_update(z, xy.retries);
+        }
+        else {
+            xy.retries++;
+            progress_update(0, xy.retries);
+            if (++retry > RETRY_MAX) {
+                tio_error_print("Too many retries");
+                write(sio, CAN_STR CAN_STR, 2);
+                return ERR;
+            }
         }
     }
 
-    /* Send EOT at 1 Hz until ACK or CAN received */
+    /* Send EOT until ACK or CAN received */
     while (1) {
+        long sent;
+
         if (key_hit)
             return ERR;
         if (write(sio, EOT_STR, 1) < 0) {
             tio_error_print("Write EOT to serial failed");
             return ERR;
         }
-        write(STDOUT_FILENO, "|", 1);
-        /* 1s timeout */
-        rc = read_poll(sio, &resp, 1, 1000);
-        if (rc < 0) {
-            tio_error_print("Read from serial failed");
+        sent = time_now_us();
+        rc = wait_response(sio, 1, sent, true);
+        if (rc < 0)
             return ERR;
-        } else if(rc == 0) {
-            continue;
-        }
+        resp = rc;
         if (resp == ACK || resp == CAN) {
-            write(STDOUT_FILENO, "\r\n", 2);
             return (resp == ACK) ? OK : ERR;
         }
+        if (++retry > RETRY_MAX) {
+            tio_error_print("Too many retries");
+            return ERR;
+        }
     }
     return 0; /* not reached */
 }
@@ -374,96 +565,39 @@ uint16_t update_CRC(uint16_t crc, char data_char)
 int receive_packet(int sio, struct xpacket packet, int fd)
 {
     char rxSeq1, rxSeq2 = 0;
-    char resp = 0;
     uint16_t calcCrc = 0;
     uint16_t rxCrc = 0;
+    uint8_t expected = packet.seq;
     int rc;
 
     struct pollfd fds;
     fds.events = POLLIN;
     fds.fd = sio;
 
-    /* Read seq bytes*/
-    rc = read_poll(sio, &rxSeq1, 1, 3000);
-    if (rc == 0) {
-        tio_error_print("Timeout waiting for first seq byte");
-        return ERR;
-    } else if (rc < 0) {
-        tio_error_print("Error reading first seq byte")
-        return ERR_FATAL;
-    }
-    rc = read_poll(sio, &rxSeq2, 1, 3000);
-    if (rc == 0) {
-        tio_error_print("Timeout waiting for second seq byte");
+    /* Read remainder of packet (seq bytes, data, CRC) in bulk. The whole
+       packet must arrive within the adaptive timeout plus its line time. */
+    rc = xy_read_full(sio, &packet.seq, sizeof(packet) - 1, timing_timeout(sizeof(packet)));
+    if (rc == USER_CAN) {
+        return USER_CAN;
+    } else if (rc == 0) {
+        tio_error_print("Timeout waiting for packet data");
         return ERR;
     } else if (rc < 0) {
-        tio_error_print("Error reading second seq byte")
+        tio_error_print("Error reading packet data")
         return ERR_FATAL;
     }
-    if (key_hit)
-            return USER_CAN;
 
-    /* Read packet Data */
+    rxSeq1 = packet.seq;
+    rxSeq2 = packet.nseq;
+    rxCrc = (uint16_t) packet.crc_hi << 8 | packet.crc_lo;
     for (unsigned ix = 0; (ix < sizeof(packet.data)); ix++)
     {
-        rc = read_poll(sio, &resp, 1, 3000);
-        /* If the read times out or fails then fail this packet. */ 
-        if (rc == 0)
-        {
-            tio_error_print("Timeout waiting for next packet char");
-            rc = write(sio, CAN_STR, 1);
-            if (rc < 0) {
-                tio_error_print("Write cancel packet to serial failed");
-                return ERR_FATAL;
-            }
-            return ERR;
-        } else if (rc < 0) {
-            tio_error_print("Error reading next packet char")
-            rc = write(sio, CAN_STR, 1);
-            if (rc < 0) {
-                tio_error_print("Write cancel packet to serial failed");
-            }
-            return ERR_FATAL;
-        }
-        packet.data[ix] = (uint8_t) resp;
-        calcCrc = update_CRC(calcCrc, resp);
-        if (key_hit)
-            return USER_CAN;
-    }
-
-    /* Read CRC */
-    rc = read_poll(sio, &resp, 1, 3000);
-    if (rc == 0) {
-        tio_error_print("Timeout waiting for first CRC byte");
-        return ERR;
-    } else if (rc < 0) {
-        tio_error_print("Error reading first CRC byte")
-        return ERR_FATAL;
-    }
-
-    uint8_t uresp = resp;
-    uint16_t uresp16 = uresp;
-    rxCrc  = uresp16 << 8;
-
-    rc = read_poll(sio, &resp, 1, 3000);
-    if (rc == 0) {
-        tio_error_print("Timeout waiting for second CRC byte");
-        return ERR;
-    } else if (rc < 0) {
-        tio_error_print("Error reading second CRC byte")
-        return ERR_FATAL;
+        calcCrc = update_CRC(calcCrc, packet.data[ix]);
     }
-    
-    uresp = resp;
-    uresp16 = uresp;
-    rxCrc |= uresp16;
-
-    if (key_hit)
-            return USER_CAN;
 
     /* At this point in the code, there should not be anything in the receive buffer
     because the sender has just sent a complete packet and is waiting on a response. */
-    rc = poll(&fds, 1, 10);
+    rc = poll(&fds, 1, 0);
     if (rc < 0)
     {
         tio_error_print("%s", strerror(errno));
@@ -490,7 +624,7 @@ int receive_packet(int sio, struct xpacket packet, int fd)
     uint8_t seq1 = rxSeq1;
     uint8_t seq2 = rxSeq2;
 
-    if ((calcCrc == rxCrc) && (seq1 == packet.seq - 1) && ((seq1 ^ seq2) == tester))
+    if ((calcCrc == rxCrc) && (seq1 == (uint8_t) (expected - 1)) && ((seq1 ^ seq2) == tester))
     {
         /* Resend of previously processed packet. */
         rc = write(sio, ACK_STR, 1);
@@ -500,7 +634,7 @@ int receive_packet(int sio, struct xpacket packet, int fd)
         }
         return RX_IGNORE;
     }
-    else if ((calcCrc != rxCrc) || (seq1 != packet.seq) || ((seq1 ^ seq2) != tester))
+    else if ((calcCrc != rxCrc) || (seq1 != expected) || ((seq1 ^ seq2) != tester))
     {
         /* Fail if the CRC or sequence number is not correct or if the two received
            sequence numbers are not the complement of one another. */
@@ -508,7 +642,7 @@ int receive_packet(int sio, struct xpacket packet, int fd)
         tio_debug_printf("CRC read: %u", rxCrc);
         tio_debug_printf("CRC calculated: %u", calcCrc);
         tio_debug_printf("Seq read: %hhu", rxSeq1);
-        tio_debug_printf("Seq should be: %hhu", packet.seq);
+        tio_debug_printf("Seq should be: %hhu", expected);
         tio_debug_printf("inv seq: %hhu", rxSeq2);
         return ERR;
     }
@@ -540,15 +674,15 @@ int xmodem_receive(int sio, int fd)
 {
     struct xpacket  packet;
     char            resp = 0;
-    int             rc;
+    int             rc, retry = 0;
     bool complete = false;
-    char status;
+    long sent = 0;
 
     /* Drain pending characters from serial line.*/
     while(1) {
         if (key_hit)
             return -1;
-        rc = read_poll(sio, &resp, 1, 50);
+        rc = read_poll(sio, &resp, 1, timing_drain());
         if (rc == 0) {
             if (resp == CAN) return ERR;
             break;
@@ -577,17 +711,37 @@ int xmodem_receive(int sio, int fd)
     }
 
     while (!complete) {
-        /* Poll for 1 new byte for 3 seconds */
-        rc = read_poll(sio, &resp, 1, 3000);
+        /* Wait for start of next packet within adaptive timeout */
+        rc = xy_read(sio, &resp, 1, timing_timeout(sizeof(packet)));
         if (rc == 0) {
-            tio_error_print("Timeout waiting for start of next packet");
-            return ERR;
+            /* Request retransmission */
+            timing_backoff();
+            xy.retries++;
+            if (++retry > RETRY_MAX) {
+                tio_error_print("Timeout waiting for start of next packet");
+                write(sio, CAN_STR CAN_STR, 2);
+                return ERR;
+            }
+            rc = write(sio, NAK_STR, 1);
+            if (rc < 0) {
+                tio_error_print("Writing not acknowledge packet to serial failed");
+                return ERR;
+            }
+            sent = 0;
+            progress_update(0, xy.retries);
+            continue;
+        } else if (rc == USER_CAN) {
+            write(sio, CAN_STR, 1);
+            return USER_CAN;
         } else if (rc < 0) {
             tio_error_print("Error reading start of next packet")
             return ERR;
         }
-        if (key_hit)
-            return USER_CAN;
+
+        /* Sample round trip from ACK to start of next packet */
+        if (sent)
+            timing_sample(time_now_us() - sent - line_time_us(1));
+        sent = 0;
 
         switch(resp)
         {
@@ -596,14 +750,23 @@ int xmodem_receive(int sio, int fd)
             rc = receive_packet(sio, packet, fd);
             if (rc == OK) {
                 packet.seq++;
-                status = '.';
+                xy.blocks++;
+                retry = 0;
+                sent = time_now_us();
+                progress_update(sizeof(packet.data), xy.retries);
             } else if (rc == ERR) {
+                xy.retries++;
+                if (++retry > RETRY_MAX) {
+                    tio_error_print("Too many retries");
+                    write(sio, CAN_STR CAN_STR, 2);
+                    return ERR;
+                }
                 rc = write(sio, NAK_STR, 1);
                 if (rc < 0) {
                     tio_error_print("Writing not acknowledge packet to serial failed");
                     return ERR;
                 }
-                status = 'N';
+                progress_update(0, xy.retries);
             } else if (rc == ERR_FATAL) {
                 tio_error_print("Receive cancelled due to fatal error");
                 return ERR;
@@ -614,8 +777,6 @@ int xmodem_receive(int sio, int fd)
                     return ERR;
                 }
                 return USER_CAN;
-            } else if (rc == RX_IGNORE) {
-                status = ':';
             }
             break;
 
@@ -628,8 +789,6 @@ int xmodem_receive(int sio, int fd)
                 return ERR;
             }
             complete = true;
-            status = '\0';
-            write(STDOUT_FILENO, "|\r\n", 3);
             break;
 
             case CAN:
@@ -643,10 +802,6 @@ int xmodem_receive(int sio, int fd)
             return ERR;
             break;
         }
-        
-
-        /* Update "progress bar" */
-        write(STDOUT_FILENO, &status, 1);
     }
     return OK;
 }
@@ -675,6 +830,8 @@ int xymodem_send(int sio, const char *filename, modem_mode_t mode)
 
     /* Do transfer */
     key_hit = 0;
+    timing_reset();
+    progress_start(len);
     if (mode == XMODEM_1K) {
         rc = xmodem_1k(sio, buf, len, 1);
     }
@@ -698,6 +855,8 @@ int xymodem_send(int sio, const char *filename, modem_mode_t mode)
         }
     }
     key_hit = 0xff;
+    progress_finish(xy.retries, ", timeouts %lu, blocks %lu, RTT %.1f ms",
+                    xy.timeouts, xy.blocks, xy.srtt / 1000.0);
 
     /* Flush serial and release resources */
     tcflush(sio, TCIOFLUSH);
@@ -719,12 +878,16 @@ int xymodem_receive(int sio, const char *filename, modem_mode_t mode)
 
     /* Do transfer */
     key_hit = 0;
+    timing_reset();
     if (mode == XMODEM_1K) {
         tio_error_print("Not supported");
         rc = -1;
     }
     else if (mode == XMODEM_CRC) {
+        progress_start(0);
         rc = xmodem_receive(sio, fd);
+        progress_finish(xy.retries, ", timeouts %lu, blocks %lu, RTT %.1f ms",
+                    xy.timeouts, xy.blocks, xy.srtt / 1000.0);
     }
     else {
         tio_error_print("Not supported");
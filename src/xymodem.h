@@ -25,6 +25,7 @@ typedef enum {
     XMODEM_1K,
     XMODEM_CRC,
     YMODEM,
+    KERMIT,
 } modem_mode_t;
 
 extern char key_hit;
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+#
+# Benchmark device discovery on synthetic device trees.
+#
+# For each number of ports, a tree is created with tools/fake-device-tree.py
+# at the discovery root tio was built with (-Ddiscovery_root). The wall time
+# of --list, of connecting by topology ID with and without a valid TID index
+# and of --auto-connect latest is reported as the median of several runs.
+#
+# Usage: bench-discovery.py <tio> <discovery root> [--ports N,...]
+#                           [--depth D] [--runs N]
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import os
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptyutil
+
+GENERATOR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools',
+                         'fake-device-tree.py')
+
+
+def generate(root, ports, depth):
+    generator = subprocess.Popen([sys.executable, GENERATOR, root, '--ports', str(ports),
+                                  '--depth', str(depth)],
+                                 stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    if generator.stdout.readline().strip() != b'ready':
+        generator.kill()
+        raise ptyutil.Failure('Failed to generate device tree')
+    return generator
+
+
+def run(workspace, args, expect):
+    """Run tio to completion, return wall time [ms]."""
+    start = time.monotonic()
+    process = workspace.spawn(args)
+    if process.wait(timeout=60) != 0:
+        raise ptyutil.Failure('%s failed' % ' '.join(args))
+    elapsed = (time.monotonic() - start) * 1000
+
+    with open(process.log, 'rb') as f:
+        if expect.encode() not in f.read():
+            raise ptyutil.Failure('Expected "%s" from %s' % (expect, ' '.join(args)))
+    return elapsed
+
+
+def median(workspace, runs, args, expect, prepare=None):
+    times = []
+    for _ in range(runs):
+        if prepare:
+            prepare()
+        times.append(run(workspace, args, expect))
+    return statistics.median(times)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('tio')
+    parser.add_argument('root')
+    parser.add_argument('--ports', default='10,100,1000')
+    parser.add_argument('--depth', type=int, default=2)
+    parser.add_argument('--runs', type=int, default=5)
+    args = parser.parse_args()
+
+    print('%6s %6s %10s %10s %10s %10s' % ('Ports', 'Depth', 'List', 'TID', 'TID', 'Auto'))
+    print('%6s %6s %10s %10s %10s %10s' % ('', '', '[ms]', 'cold [ms]', 'index [ms]', '[ms]'))
+
+    with ptyutil.Workspace() as workspace:
+        index = os.path.join(workspace.path, 'tio', 'tid-index')
+
+        def forget_index():
+            if os.path.exists(index):
+                os.remove(index)
+
+        for ports in [int(p) for p in args.ports.split(',')]:
+            generator = generate(args.root, ports, args.depth)
+            try:
+                last = 'ttyUSB%d' % (ports - 1)
+                listing = median(workspace, args.runs, [args.tio, '--list'], last)
+
+                # Connect to the last port by its topology ID
+                with open(workspace.processes[-1].log) as f:
+                    tid = re.search(r'/%s\s+(\S{4})\s' % last, f.read()).group(1)
+                connected = 'Connected to %s/dev/%s' % (args.root, last)
+                cold = median(workspace, args.runs, [args.tio, tid], connected, forget_index)
+                indexed = median(workspace, args.runs, [args.tio, tid], connected)
+
+                auto = median(workspace, args.runs, [args.tio, '--auto-connect', 'latest'],
+                              'Connected to')
+            finally:
+                generator.stdin.close()
+                generator.wait()
+
+            print('%6d %6d %10.1f %10.1f %10.1f %10.1f' %
+                  (ports, args.depth, listing, cold, indexed, auto))
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    ptyutil.run(main)
@@ -0,0 +1,71 @@
+-- Decoder run by bench-lua-decode.py. Frames are 0x7e, payload length,
+-- little endian int16 samples and the sum of the payload bytes modulo 256.
+-- The benchmark sets BYTES to the amount of data it feeds and VIEW to decode
+-- FFI views (LuaJIT) instead of strings.
+
+local state, length, index, low, sum, check = 0, 0, 0, 0, 0, 0
+local frames, errors, total, received, elapsed = 0, 0, 0, 0, 0
+
+local function decode(byte)
+  if state == 0 then
+    if byte == 0x7e then
+      state = 1
+    end
+  elseif state == 1 then
+    length, index, sum, check = byte, 0, 0, 0
+    state = (length > 0) and 2 or 3
+  elseif state == 2 then
+    check = (check + byte) % 256
+    if index % 2 == 0 then
+      low = byte
+    else
+      local sample = low + byte * 256
+      if sample >= 32768 then
+        sample = sample - 65536
+      end
+      sum = sum + sample
+    end
+    index = index + 1
+    if index == length then
+      state = 3
+    end
+  else
+    if byte == check then
+      frames = frames + 1
+      total = total + sum
+    else
+      errors = errors + 1
+    end
+    state = 0
+  end
+end
+
+local function done(length)
+  received = received + length
+  if received >= BYTES then
+    print(string.format("decoded %d bytes, %d frames, %d errors, sum %d in %.6f s (%s)",
+                        received, frames, errors, total, elapsed,
+                        jit and jit.version or _VERSION))
+  end
+end
+
+if VIEW then
+  tio.on_rx(function(data, length)
+    local start = os.clock()
+    for i = 0, length - 1 do
+      decode(data[i])
+    end
+    elapsed = elapsed + os.clock() - start
+    done(length)
+  end, true)
+else
+  tio.on_rx(function(data)
+    local start = os.clock()
+    local byte = string.byte
+    for i = 1, #data do
+      decode(byte(data, i))
+    end
+    elapsed = elapsed + os.clock() - start
+    done(#data)
+  end)
+end
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Benchmark decoding of a recorded frame capture in a tio on_rx hook.
+#
+# The capture (lua-decode-capture.bin) is fed repeatedly to tio over a pty
+# pair and decoded by bench-lua-decode.lua, which reports the CPU time spent
+# in the hook. Results are checked against a reference decoder. Hooks get
+# Lua strings, and with LuaJIT also FFI views of the received data. To
+# compare PUC Lua with LuaJIT, pass a second tio built with -Dluajit=enabled
+# with --compare.
+#
+# Usage: bench-lua-decode.py <tio> [--compare <tio>,...] [--repeat N]
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptyutil
+
+DIRECTORY = os.path.dirname(os.path.abspath(__file__))
+CAPTURE = os.path.join(DIRECTORY, 'lua-decode-capture.bin')
+SCRIPT = os.path.join(DIRECTORY, 'bench-lua-decode.lua')
+
+
+def reference(data):
+    """Decode frames like bench-lua-decode.lua, return frames, errors, sum."""
+    frames = errors = total = 0
+    i = 0
+    while i < len(data):
+        if data[i] != 0x7e or i + 1 >= len(data):
+            i += 1
+            continue
+        length = data[i + 1]
+        if i + 2 + length >= len(data):
+            break
+        payload = data[i + 2:i + 2 + length]
+        if data[i + 2 + length] == sum(payload) & 0xff:
+            frames += 1
+            total += sum(struct.unpack('<%dh' % (length // 2), payload[:length & ~1]))
+        else:
+            errors += 1
+        i += 3 + length
+    return frames, errors, total
+
+
+def decode(tio, workspace, data, view):
+    port = ptyutil.Port()
+    terminal = ptyutil.Port()
+    script = 'BYTES = %d VIEW = %s dofile("%s")' % (len(data), 'true' if view else 'false', SCRIPT)
+
+    try:
+        # Hooks only run in interactive mode, so give tio a terminal
+        process = workspace.spawn([tio, '--script', script, port.name], stdin=terminal.slave)
+        ptyutil.wait_for_output(process, 'Connected to', 5)
+        for offset in range(0, len(data), 4096):
+            port.write(data[offset:offset + 4096])
+        ptyutil.wait_for_output(process, 'decoded', 600)
+        process.kill()
+        process.wait()
+    finally:
+        port.close()
+        terminal.close()
+
+    with open(process.log, 'rb') as f:
+        result = re.search(rb'decoded (\d+) bytes, (\d+) frames, (\d+) errors, sum (-?\d+) '
+                           rb'in ([0-9.]+) s \(([^)]*)\)', f.read())
+    if result is None:
+        raise ptyutil.Failure('No decode result from %s' % tio)
+
+    return {
+        'decoded': tuple(int(result.group(i)) for i in (2, 3, 4)),
+        'elapsed': float(result.group(5)),
+        'lua': result.group(6).decode(),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('tio')
+    parser.add_argument('--compare', default='')
+    parser.add_argument('--repeat', type=int, default=32)
+    args = parser.parse_args()
+
+    with open(CAPTURE, 'rb') as f:
+        data = f.read() * args.repeat
+    expected = reference(data)
+
+    print('%-22s %-6s %10s %10s %10s %8s' % ('Lua', 'Data', 'Size', 'Frames', 'Time', 'Rate'))
+    print('%-22s %-6s %10s %10s %10s %8s' % ('', '', '[KiB]', '', '[s]', '[MB/s]'))
+
+    with ptyutil.Workspace() as workspace:
+        for tio in [args.tio] + [t for t in args.compare.split(',') if t]:
+            views = [False]
+            while views:
+                view = views.pop(0)
+                r = decode(tio, workspace, data, view)
+                if r['decoded'] != expected:
+                    raise ptyutil.Failure('Decoded %s, expected %s' % (r['decoded'], expected))
+                print('%-22s %-6s %10d %10d %10.3f %8.1f' %
+                      (r['lua'], 'view' if view else 'string', len(data) // 1024,
+                       expected[0], r['elapsed'],
+                       len(data) / r['elapsed'] / 1e6 if r['elapsed'] > 0 else 0))
+                sys.stdout.flush()
+                if not view and r['lua'].startswith('LuaJIT'):
+                    views.append(True)
+
+
+if __name__ == '__main__':
+    ptyutil.run(main)
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+#
+# Benchmark tio X/YMODEM file transfers over pty pairs.
+#
+# The tio sender and the receiver are connected through a relay which
+# delays data in both directions to simulate line latency. The receiver is
+# tio for XMODEM-CRC, else lrzsz (rx/rb) if installed, else a minimal
+# receiver built into this script. The transfer time is measured from the
+# start of the receiver until the sender exits. Next to the resulting rate,
+# the rate tio reports in its summary is shown. For the sender, CPU time,
+# context switches and the number of read() and write() system calls (as
+# accounted in /proc/<pid>/io, other system calls are not counted) are
+# reported.
+#
+# Usage: bench-xymodem.py <tio> [--sizes KiB,...] [--latencies ms,...]
+#                                [--protocols name,...]
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import binascii
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptyutil
+
+SOH = 0x01
+STX = 0x02
+EOT = 0x04
+ACK = 0x06
+
+PROTOCOLS = ['xmodem-crc', 'xmodem-1k', 'ymodem']
+
+
+def receive_blocks(port, data):
+    """Receive XMODEM blocks into data until EOT, or a single YMODEM header block."""
+    expected = None
+    while True:
+        header = port.read(1, 10)[0]
+        if header == EOT:
+            port.write(bytes([ACK]))
+            return
+        if header not in (SOH, STX):
+            raise ptyutil.Failure('Unexpected start of block 0x%02x' % header)
+
+        size = 128 if header == SOH else 1024
+        packet = port.read(size + 4, 10)
+        payload = packet[2:2 + size]
+        if binascii.crc_hqx(payload, 0) != (packet[-2] << 8 | packet[-1]):
+            raise ptyutil.Failure('CRC error in block %d' % packet[0])
+
+        if expected is None or packet[0] == expected:
+            data += payload
+            expected = (packet[0] + 1) & 0xff
+        port.write(bytes([ACK]))
+
+        # Block 0 is a YMODEM header and is sent on its own
+        if packet[0] == 0 and len(data) == size:
+            return
+
+
+def start(port):
+    """Request CRC mode until the sender starts."""
+    for _ in range(40):
+        port.write(b'C')
+        if port.readable(0.25):
+            return
+    raise ptyutil.Failure('Sender did not start')
+
+
+def receive_builtin(port, protocol):
+    data = bytearray()
+    start(port)
+    if protocol != 'ymodem':
+        receive_blocks(port, data)
+        return bytes(data)
+
+    header = bytearray()
+    receive_blocks(port, header)
+    length = int(header.split(b'\0')[1].split(b' ')[0])
+    start(port)
+    receive_blocks(port, data)
+    start(port)
+    receive_blocks(port, bytearray())
+    return bytes(data[:length])
+
+
+def lrzsz(name):
+    for program in (name, 'l' + name):
+        path = shutil.which(program)
+        if path:
+            return path
+    return None
+
+
+def transfer(tio, workspace, protocol, payload, latency):
+    sender = ptyutil.Port()
+    receiver = ptyutil.Port()
+    relay = ptyutil.Relay(sender, receiver, latency)
+    relay.start()
+
+    source = workspace.write('payload.bin', payload)
+    destination = os.path.join(workspace.path, 'received.bin')
+    if os.path.exists(destination):
+        os.remove(destination)
+
+    try:
+        process = workspace.spawn([tio, '--send', protocol + ':' + source, sender.name])
+
+        # Let sender flush stale input before the receiver starts
+        ptyutil.wait_for_output(process, 'Sending file', 5)
+        start = time.monotonic()
+
+        if protocol == 'xmodem-crc':
+            name = 'tio'
+            rx = workspace.spawn([tio, '--receive', 'xmodem-crc:' + destination, receiver.name])
+        elif lrzsz('rx' if protocol != 'ymodem' else 'rb'):
+            name = 'lrzsz'
+            if protocol == 'ymodem':
+                args = [lrzsz('rb')]
+            else:
+                args = [lrzsz('rx'), '-c', destination]
+            with open(receiver.name, 'r+b', buffering=0) as line:
+                rx = subprocess.Popen(args, stdin=line, stdout=line, stderr=subprocess.DEVNULL,
+                                      cwd=workspace.path)
+        else:
+            name = 'builtin'
+            rx = None
+            with open(destination, 'wb') as f:
+                f.write(receive_builtin(receiver.line(), protocol))
+
+        status, usage, io = ptyutil.wait_usage(process, 600)
+        elapsed = time.monotonic() - start
+        if rx is not None and rx.wait(timeout=30) != 0:
+            raise ptyutil.Failure('%s receiver failed' % name)
+    finally:
+        relay.stop()
+        sender.close()
+        receiver.close()
+
+    if status != 0:
+        raise ptyutil.Failure('tio sender failed')
+
+    if protocol == 'ymodem' and name == 'lrzsz':
+        destination = os.path.join(workspace.path, os.path.basename(source))
+    with open(destination, 'rb') as f:
+        if f.read()[:len(payload)] != payload:
+            raise ptyutil.Failure('Received data differs from sent file')
+
+    with open(process.log, 'rb') as f:
+        summary = re.search(rb'Transferred \d+ bytes in [0-9.]+ s, ([0-9]+) bytes/s', f.read())
+    reported = int(summary.group(1)) if summary else 0
+
+    return {
+        'receiver': name,
+        'elapsed': elapsed,
+        'rate': len(payload) / elapsed,
+        'reported': reported,
+        'cpu': usage.ru_utime + usage.ru_stime,
+        'switches': usage.ru_nvcsw + usage.ru_nivcsw,
+        'reads': io['syscr'],
+        'writes': io['syscw'],
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('tio')
+    parser.add_argument('--sizes', default='16,128')
+    parser.add_argument('--latencies', default='0,1,10')
+    parser.add_argument('--protocols', default=','.join(PROTOCOLS))
+    args = parser.parse_args()
+
+    print('%-10s %8s %8s %-8s %8s %10s %10s %7s %8s %8s %8s' %
+          ('Protocol', 'Size', 'Latency', 'Receiver', 'Time', 'Rate', 'tio rate', 'CPU',
+           'Switches', 'read()', 'write()'))
+    print('%-10s %8s %8s %-8s %8s %10s %10s %7s %8s %8s %8s' %
+          ('', '[KiB]', '[ms]', '', '[s]', '[bytes/s]', '[bytes/s]', '[s]', '', '[calls]',
+           '[calls]'))
+
+    with ptyutil.Workspace() as workspace:
+        for protocol in args.protocols.split(','):
+            for size in [int(s) for s in args.sizes.split(',')]:
+                payload = os.urandom(size * 1024)
+                for latency in [float(l) for l in args.latencies.split(',')]:
+                    r = transfer(args.tio, workspace, protocol, payload, latency / 1000)
+                    print('%-10s %8d %8g %-8s %8.2f %10.0f %10d %7.3f %8d %8d %8d' %
+                          (protocol, size, latency, r['receiver'], r['elapsed'], r['rate'],
+                           r['reported'], r['cpu'], r['switches'], r['reads'], r['writes']))
+                    sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    ptyutil.run(main)
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# Transfer a file between two tio instances using Kermit over pty pairs
+# connected through a relay which delays data by 2 ms each way. Covers
+# sliding windows, streaming (negotiated with hardware flow control) and
+# 8th bit prefixing on 7-bit links. If gkermit is installed, files are also
+# sent to and received from it.
+#
+# Usage: kermit-transfer.py <tio>
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptyutil
+
+FILE_SIZE = 200000
+LATENCY = 0.002
+
+
+def transfer(workspace, sender, receiver, payload, check):
+    a = ptyutil.Port()
+    b = ptyutil.Port()
+    relay = ptyutil.Relay(a, b, LATENCY)
+    relay.start()
+
+    source = workspace.write('payload.bin', payload)
+    destination = os.path.join(workspace.path, 'received.bin')
+    if os.path.exists(destination):
+        os.remove(destination)
+
+    try:
+        rx = receiver(b, destination)
+        tx = sender(a, source)
+        for process in (tx, rx):
+            if process.wait(timeout=60) != 0:
+                raise ptyutil.Failure('%s failed' % process.args[0])
+    finally:
+        relay.stop()
+        a.close()
+        b.close()
+
+    if not os.path.exists(destination):
+        destination = os.path.join(workspace.path, 'received', os.path.basename(source))
+    if not os.path.exists(destination):
+        raise ptyutil.Failure('No file received')
+    with open(destination, 'rb') as f:
+        if f.read() != payload:
+            raise ptyutil.Failure('Received data differs from sent file')
+
+    for process in (tx, rx):
+        if hasattr(process, 'log'):
+            with open(process.log) as f:
+                if check not in f.read():
+                    raise ptyutil.Failure('Expected "%s" in transfer summary' % check)
+
+
+def main():
+    tio = sys.argv[1]
+    payload = os.urandom(FILE_SIZE)
+
+    def tio_send(args):
+        def start(port, source):
+            time.sleep(0.2)
+            return workspace.spawn([tio, '--send', 'kermit:' + source, port.name] + args)
+        return start
+
+    def tio_receive(args):
+        def start(port, destination):
+            return workspace.spawn([tio, '--receive', 'kermit:' + destination, port.name] + args)
+        return start
+
+    def gkermit(args):
+        def start(port, path):
+            directory = os.path.join(workspace.path, 'received')
+            os.makedirs(directory, exist_ok=True)
+            command = [shutil.which('gkermit'), '-q'] + (['-s', path] if args == 'send' else ['-r'])
+            with open(port.name, 'r+b', buffering=0) as line:
+                return subprocess.Popen(command, stdin=line, stdout=line,
+                                        stderr=subprocess.DEVNULL, cwd=directory)
+        return start
+
+    with ptyutil.Workspace() as workspace:
+        transfer(workspace, tio_send([]), tio_receive([]), payload, 'window 31')
+        transfer(workspace, tio_send(['--flow', 'hard']), tio_receive(['--flow', 'hard']),
+                 payload, '(streaming)')
+        seven_bit = ['--databits', '7', '--parity', 'even']
+        transfer(workspace, tio_send(seven_bit), tio_receive(seven_bit), payload, 'Transferred')
+
+        if shutil.which('gkermit'):
+            transfer(workspace, tio_send([]), gkermit('receive'), payload, 'Transferred')
+            transfer(workspace, gkermit('send'), tio_receive([]), payload, 'Transferred')
+
+
+if __name__ == '__main__':
+    ptyutil.run(main)
@@ -0,0 +1,181 @@
+#
+# Helpers for running tio against the other end of a pty pair.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import heapq
+import os
+import pty
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import tty
+
+
+class Failure(Exception):
+    pass
+
+
+class Endpoint:
+    """Raw byte stream on a file descriptor."""
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    def read(self, size, timeout):
+        """Read exactly size bytes or fail after timeout seconds."""
+        data = bytearray()
+        deadline = time.monotonic() + timeout
+        while len(data) < size:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise Failure('Timeout waiting for %d bytes, got %d' % (size, len(data)))
+            ready, _, _ = select.select([self.fd], [], [], remaining)
+            if ready:
+                data += os.read(self.fd, size - len(data))
+        return bytes(data)
+
+    def readable(self, timeout):
+        """Wait at most timeout seconds for data to become available."""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        return bool(ready)
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+
+class Port(Endpoint):
+    """Master side of a raw pty pair, tio is connected to the slave side."""
+
+    def __init__(self):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.master)
+        tty.setraw(self.slave)
+        self.name = os.ttyname(self.slave)
+        super().__init__(self.master)
+
+    def line(self):
+        """Slave side, for use in place of a tio instance."""
+        return Endpoint(self.slave)
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+
+class Relay(threading.Thread):
+    """Forward data between two ports, delayed by latency seconds each way."""
+
+    def __init__(self, a, b, latency):
+        super().__init__(daemon=True)
+        self.peer = {a.master: b.master, b.master: a.master}
+        self.latency = latency
+        self.stopped = False
+
+    def run(self):
+        pending = []
+        count = 0
+        while not self.stopped:
+            now = time.monotonic()
+            while pending and pending[0][0] <= now:
+                _, _, fd, data = heapq.heappop(pending)
+                os.write(fd, data)
+            timeout = min(pending[0][0] - now, 0.05) if pending else 0.05
+            ready, _, _ = select.select(list(self.peer), [], [], max(timeout, 0))
+            for fd in ready:
+                data = os.read(fd, 65536)
+                if self.latency == 0:
+                    os.write(self.peer[fd], data)
+                else:
+                    count += 1
+                    heapq.heappush(pending, (time.monotonic() + self.latency, count,
+                                             self.peer[fd], data))
+
+    def stop(self):
+        self.stopped = True
+        self.join()
+
+
+def wait_for_output(process, text, timeout):
+    """Wait until text shows up in the output of a spawned process."""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        with open(process.log, 'rb') as f:
+            if text.encode() in f.read():
+                return
+        if process.poll() is not None:
+            raise Failure('Process exited before printing "%s"' % text)
+        time.sleep(0.01)
+    raise Failure('Timeout waiting for "%s"' % text)
+
+
+def wait_usage(process, timeout):
+    """Wait for process to exit, return exit status, resource usage and I/O
+    accounting. The I/O accounting is read before the process is reaped."""
+    deadline = time.monotonic() + timeout
+    while os.waitid(os.P_PID, process.pid, os.WEXITED | os.WNOWAIT | os.WNOHANG) is None:
+        if time.monotonic() > deadline:
+            raise Failure('Timeout waiting for process to exit')
+        time.sleep(0.001)
+
+    io = {}
+    with open('/proc/%d/io' % process.pid) as f:
+        for line in f:
+            key, value = line.split(':')
+            io[key] = int(value)
+
+    _, status, usage = os.wait4(process.pid, 0)
+    process.returncode = os.waitstatus_to_exitcode(status)
+    return process.returncode, usage, io
+
+
+class Workspace:
+    """Temporary directory used as HOME so no user configuration is read."""
+
+    def __enter__(self):
+        self.path = tempfile.mkdtemp(prefix='tio-test-')
+        self.processes = []
+        return self
+
+    def __exit__(self, exc_type, *args):
+        for process in self.processes:
+            if process.poll() is None:
+                process.kill()
+                process.wait()
+            if exc_type is not None:
+                with open(process.log, 'rb') as f:
+                    sys.stdout.write(f.read().decode(errors='replace'))
+        shutil.rmtree(self.path)
+
+    def write(self, name, data):
+        filename = os.path.join(self.path, name)
+        with open(filename, 'wb') as f:
+            f.write(data)
+        return filename
+
+    def environment(self):
+        env = dict(os.environ, HOME=self.path, XDG_CONFIG_HOME=self.path,
+                   XDG_RUNTIME_DIR=self.path)
+        return env
+
+    def spawn(self, args, **kwargs):
+        log = open(os.path.join(self.path, 'tio-%d.log' % len(self.processes)), 'wb')
+        kwargs.setdefault('stdin', subprocess.DEVNULL)
+        process = subprocess.Popen(args, stdout=log, stderr=subprocess.STDOUT,
+                                   env=self.environment(), **kwargs)
+        process.log = log.name
+        self.processes.append(process)
+        return process
+
+
+def run(main):
+    try:
+        main()
+    except Failure as error:
+        print('FAIL: %s' % error)
+        sys.exit(1)
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+#
+# Send a file with tio using XMODEM-CRC to a receiver on the other side of a
+# pty pair that is slow to ACK some blocks, as e.g. a bootloader erasing flash,
+# and that NAKs the block following a slow one, as on a line error. A sender
+# that takes a late ACK for the response to a retransmission gets out of sync
+# and answers the NAK with the wrong block.
+#
+# Usage: xymodem-delayed-receiver.py <tio>
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptyutil
+
+SOH = 0x01
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+
+FILE_SIZE = 4096
+SLOW_EVERY = 8          # Every n-th block is ACKed late
+SLOW_DELAY = 0.4        # Late ACK delay [s]
+FAST_DELAY = 0.002      # Normal ACK delay [s]
+
+
+def crc16(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+
+def receive(port):
+    data = bytearray()
+    expected = 1
+    block = 0
+    nak = False
+
+    # Request CRC mode until sender starts
+    for _ in range(20):
+        port.write(b'C')
+        if port.readable(0.5):
+            break
+
+    while True:
+        header = port.read(1, 10)
+        if header[0] == EOT:
+            port.write(bytes([ACK]))
+            return bytes(data)
+        if header[0] != SOH:
+            raise ptyutil.Failure('Unexpected start of block 0x%02x' % header[0])
+
+        packet = port.read(132, 10)
+        seq, nseq, payload = packet[0], packet[1], packet[2:130]
+        if seq != 0xff - nseq:
+            raise ptyutil.Failure('Corrupt sequence number')
+        if crc16(payload) != (packet[130] << 8 | packet[131]):
+            raise ptyutil.Failure('CRC error in block %d' % seq)
+
+        if seq == expected & 0xff:
+            if nak:
+                nak = False
+                port.write(bytes([NAK]))
+                continue
+            data += payload
+            expected += 1
+        elif seq != (expected - 1) & 0xff:
+            raise ptyutil.Failure('Out of sequence block %d, expected %d' % (seq, expected & 0xff))
+
+        block += 1
+        if block % SLOW_EVERY == 0:
+            time.sleep(SLOW_DELAY)
+            nak = True
+        else:
+            time.sleep(FAST_DELAY)
+        port.write(bytes([ACK]))
+
+
+def main():
+    payload = os.urandom(FILE_SIZE)
+
+    with ptyutil.Workspace() as workspace:
+        filename = workspace.write('payload.bin', payload)
+        port = ptyutil.Port()
+        tio = workspace.spawn([sys.argv[1], '--send', 'xmodem-crc:' + filename, port.name])
+
+        received = receive(port)
+        status = tio.wait(timeout=10)
+
+        if status != 0:
+            raise ptyutil.Failure('tio exited with status %d' % status)
+        if received[:FILE_SIZE] != payload:
+            raise ptyutil.Failure('Received data differs from sent file')
+
+
+if __name__ == '__main__':
+    ptyutil.run(main)
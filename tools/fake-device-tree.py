@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+#
+# Generate a synthetic sysfs and /dev tree for device discovery, for use with
+# tio built with -Ddiscovery_root=<root>.
+#
+# Creates N USB serial ports below USB hubs nested <depth> levels deep, laid
+# out like the kernel does:
+#
+#   sys/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1.2/1-1.2:1.0/ttyUSB0
+#   sys/class/tty/ttyUSB0 -> ../../devices/.../ttyUSB0/tty/ttyUSB0
+#   dev/ttyUSB0 -> /dev/pts/<n>
+#   dev/serial/by-id/usb-FTDI_FT232R_USB_UART_<serial>-if00-port0 -> ../../ttyUSB0
+#   dev/serial/by-path/pci-0000:00:14.0-usb-0:1.2:1.0-port0 -> ../../ttyUSB0
+#
+# Device nodes are symlinks to ptys, which only exist while this program
+# holds them open. It prints "ready" when the tree is complete and keeps
+# running until stdin is closed or it is terminated.
+#
+# Usage: fake-device-tree.py <root> [--ports N] [--depth D]
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import os
+import resource
+import shutil
+import signal
+import sys
+
+HUB_PORTS = 7
+PCI_DEVICE = '0000:00:14.0'
+DRIVER = 'ftdi_sio'
+PRODUCT = 'FT232R USB UART'
+
+
+def symlink(target, path):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    os.symlink(target, path)
+
+
+def write(path, text):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, 'w') as f:
+        f.write(text + '\n')
+
+
+def hub_path(index, depth):
+    """USB bus and port chain of port index, e.g. (1, ['1', '2', '3'])."""
+    chain = []
+    for _ in range(max(depth, 1)):
+        chain.insert(0, str(index % HUB_PORTS + 1))
+        index //= HUB_PORTS
+    return index + 1, chain
+
+
+def create(root, ports, depth):
+    """Create tree with ports pty-backed device nodes, return pty masters."""
+    if os.path.exists(root):
+        shutil.rmtree(root)
+
+    # One descriptor is held per port
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft != resource.RLIM_INFINITY and soft < ports + 64:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(ports + 64, hard), hard))
+
+    drivers = os.path.join(root, 'sys', 'bus', 'usb-serial', 'drivers', DRIVER)
+    os.makedirs(drivers)
+
+    masters = []
+    for index in range(ports):
+        name = 'ttyUSB%d' % index
+        bus, chain = hub_path(index, depth)
+
+        # Each hub level is a directory below its parent hub
+        device = os.path.join('devices', 'pci0000:00', PCI_DEVICE, 'usb%d' % bus)
+        for level in range(len(chain)):
+            device = os.path.join(device, '%d-%s' % (bus, '.'.join(chain[:level + 1])))
+        interface = os.path.join(device, os.path.basename(device) + ':1.0')
+        port = os.path.join(interface, name)
+
+        sys_root = os.path.join(root, 'sys')
+        write(os.path.join(sys_root, device, 'product'), PRODUCT)
+        write(os.path.join(sys_root, interface, 'interface'), PRODUCT)
+        symlink(os.path.relpath(drivers, os.path.join(sys_root, port)),
+                os.path.join(sys_root, port, 'driver'))
+        symlink('../../../' + name, os.path.join(sys_root, port, 'tty', name, 'device'))
+        symlink(os.path.join('..', '..', port, 'tty', name),
+                os.path.join(sys_root, 'class', 'tty', name))
+
+        master, slave = os.openpty()
+        node = os.ttyname(slave)
+        os.close(slave)
+        masters.append(master)
+
+        dev = os.path.join(root, 'dev')
+        symlink(node, os.path.join(dev, name))
+        symlink('../../' + name, os.path.join(dev, 'serial', 'by-id',
+                'usb-FTDI_FT232R_USB_UART_A%07X-if00-port0' % index))
+        symlink('../../' + name, os.path.join(dev, 'serial', 'by-path',
+                'pci-%s-usb-%d:%s:1.0-port0' % (PCI_DEVICE, bus - 1, '.'.join(chain))))
+
+    return masters
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('root')
+    parser.add_argument('--ports', type=int, default=10)
+    parser.add_argument('--depth', type=int, default=2)
+    args = parser.parse_args()
+
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+
+    create(args.root, args.ports, args.depth)
+    print('ready')
+    sys.stdout.flush()
+
+    # Keep ptys open until stdin is closed
+    sys.stdin.read()
+
+
+if __name__ == '__main__':
+    main()